@@ -14,6 +14,8 @@ set(CMAKE_EXPORT_COMPILE_COMMANDS ON)
 #                     [BINDING binding] # Binding definition (overrides config)
 #                     [CONFIGURATION config_file]
 #                     [NAMESPACES namespace1 namespace2 ...])
+#                     [SHARDS count] # Pack bindings into `count` files
+#                                    # and generate them in the same build
 #                     SOURCES source1_file [source2_file ...]
 #                     [EXTRA_SOURCES source1_file ...]
 #                     [DEBUG] [EXCLUDE_FROM_ALL]
@@ -24,7 +26,7 @@ function(add_chimera_binding)
     # Unparsed arguments can be found in variable ARG_UNPARSED_ARGUMENTS.
     set(prefix binding)
     set(options DEBUG EXCLUDE_FROM_ALL)
-    set(oneValueArgs TARGET MODULE CONFIGURATION DESTINATION BINDING)
+    set(oneValueArgs TARGET MODULE CONFIGURATION DESTINATION BINDING SHARDS)
     set(multiValueArgs SOURCES NAMESPACES EXTRA_SOURCES LINK_LIBRARIES)
     cmake_parse_arguments("${prefix}" "${options}" "${oneValueArgs}" "${multiValueArgs}" ${ARGN})
 
@@ -63,6 +65,9 @@ function(add_chimera_binding)
         if(binding_CONFIGURATION)
             message(STATUS "  Configuration: ${binding_CONFIGURATION}")
         endif()
+        if(binding_SHARDS)
+            message(STATUS "  Shards: ${binding_SHARDS}")
+        endif()
         if(binding_NAMESPACES)
             message(STATUS "  Namespaces:")
             foreach(namespace ${binding_NAMESPACES})
@@ -101,6 +106,8 @@ function(add_chimera_binding)
     list(APPEND binding_ARGS -m "${binding_MODULE}")
     list(APPEND binding_ARGS -o "${binding_DESTINATION}")
     list(APPEND binding_ARGS -p "${PROJECT_BINARY_DIR}")
+    list(APPEND binding_ARGS -incremental)
+    list(APPEND binding_ARGS -preamble-cache "${binding_DESTINATION}/preamble")
     if(binding_BINDING)
         list(APPEND binding_ARGS -b "${binding_BINDING}")
     endif()
@@ -112,33 +119,83 @@ function(add_chimera_binding)
             list(APPEND binding_ARGS -n "${namespace}")
         endforeach()
     endif()
+    if(binding_SHARDS)
+        list(APPEND binding_ARGS -shards "${binding_SHARDS}")
+    endif()
+    set(binding_MANIFEST "${binding_DESTINATION}/manifest.json")
+    list(APPEND binding_ARGS -manifest "${binding_MANIFEST}")
+
+    # Chimera writes a depfile that lists every file that it read, so that the
+    # bindings are regenerated exactly when one of them changes.  DEPFILE is
+    # supported by Ninja since CMake 3.7 and by Makefiles since CMake 3.20.
+    set(binding_DEPFILE_ARGS)
+    if((CMAKE_GENERATOR MATCHES "Ninja" AND NOT CMAKE_VERSION VERSION_LESS 3.7)
+       OR (CMAKE_GENERATOR MATCHES "Makefiles"
+           AND NOT CMAKE_VERSION VERSION_LESS 3.20))
+        set(binding_DEPFILE "${binding_DESTINATION}/sources.d")
+        file(RELATIVE_PATH binding_DEPFILE_TARGET
+            "${CMAKE_BINARY_DIR}" "${binding_SOURCES_TXT}"
+        )
+        list(APPEND binding_ARGS -depfile "${binding_DEPFILE}")
+        list(APPEND binding_ARGS -depfile-target "${binding_DEPFILE_TARGET}")
+        set(binding_DEPFILE_ARGS DEPFILE "${binding_DEPFILE}")
+    endif()
     list(APPEND binding_ARGS ${binding_SOURCES})
     list(APPEND binding_ARGS > "${binding_SOURCES_TXT}.staging")
 
-    # Create an external target that re-runs chimera when any of the sources have changed.
-    # This will necessarily invalidate a placeholder dependency that causes CMake to
-    # rerun the compilation of the library if sources are regenerated.
+    # With a fixed number of shards, the list of generated sources is known
+    # before chimera runs.  Otherwise, get the current list of generated
+    # sources if already generated.
+    set(binding_PRELUDE "${binding_DESTINATION}/${binding_MODULE}_prelude.h")
+    if(binding_SHARDS)
+        set(binding_GENERATED
+            "${binding_DESTINATION}/${binding_MODULE}.cpp"
+            "${binding_PRELUDE}"
+        )
+        math(EXPR binding_LAST_SHARD "${binding_SHARDS} - 1")
+        foreach(shard RANGE ${binding_LAST_SHARD})
+            list(APPEND binding_GENERATED
+                "${binding_DESTINATION}/${binding_MODULE}_shard_${shard}.cpp")
+        endforeach()
+        set_source_files_properties(${binding_GENERATED}
+            PROPERTIES GENERATED TRUE
+        )
+    elseif(EXISTS "${binding_SOURCES_TXT}")
+        file(STRINGS "${binding_SOURCES_TXT}" binding_GENERATED_RELATIVE NO_HEX_CONVERSION)
+
+        set(binding_GENERATED)
+        foreach(relative_path ${binding_GENERATED_RELATIVE})
+            list(APPEND binding_GENERATED "${binding_DESTINATION}/${relative_path}")
+        endforeach()
+    endif()
+
+    # With a fixed number of shards, the generated files are byproducts of
+    # chimera, so that they are generated and compiled in a single build graph.
+    # Otherwise, the library target is rebuilt by an external project after
+    # the sources have been generated, since they are only known afterwards.
+    # BYPRODUCTS requires CMake 3.2.
+    set(binding_BYPRODUCTS_ARGS)
+    if(binding_SHARDS AND NOT CMAKE_VERSION VERSION_LESS 3.2)
+        set(binding_SINGLE_PASS TRUE)
+        set(binding_BYPRODUCTS_ARGS BYPRODUCTS ${binding_GENERATED})
+    else()
+        set(binding_SINGLE_PASS FALSE)
+    endif()
+
+    # Create a target that re-runs chimera when any of the sources have changed.
     add_custom_target("${binding_TARGET}_SOURCES" DEPENDS "${binding_SOURCES_TXT}")
     add_custom_command(
-        OUTPUT "${binding_SOURCES_TXT}"
+        OUTPUT "${binding_SOURCES_TXT}" "${binding_MANIFEST}"
+        ${binding_BYPRODUCTS_ARGS}
         COMMAND "${chimera_EXECUTABLE}" ARGS ${binding_ARGS}
         COMMAND ${CMAKE_COMMAND} ARGS -E rename "${binding_SOURCES_TXT}.staging" "${binding_SOURCES_TXT}"
         DEPENDS "${binding_CONFIGURATION}" ${binding_SOURCES}
+        ${binding_DEPFILE_ARGS}
         WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
         COMMENT "Generating bindings for ${binding_TARGET}."
         VERBATIM
     )
 
-    # Get the current list of generated sources if already generated.
-    if(EXISTS "${binding_SOURCES_TXT}")
-        file(STRINGS "${binding_SOURCES_TXT}" binding_GENERATED_RELATIVE NO_HEX_CONVERSION)
-
-        set(binding_GENERATED)
-        foreach(relative_path ${binding_GENERATED_RELATIVE})
-            list(APPEND binding_GENERATED "${binding_DESTINATION}/${relative_path}")
-        endforeach()
-    endif()
-
     # Placeholder target to generate compilation database.
     #
     # (We force all SOURCES to be treated as CXX so that we can generate bindings
@@ -173,20 +230,39 @@ function(add_chimera_binding)
         ${binding_EXTRA_SOURCES}
     )
 
-    # Trigger the rebuild of the library target after new sources have been generated.
-    #
-    # For BUILD_COMMAND, '$(MAKE)' is used instead of 'make' to propagate the
-    # make commands of the parent project to the child process.
-    # (see: http://stackoverflow.com/a/33171336)
-    ExternalProject_Add("${binding_TARGET}_REBUILD"
-        DOWNLOAD_COMMAND ""
-        INSTALL_COMMAND ""
-        BUILD_COMMAND $(MAKE) "${binding_TARGET}_SOURCES"
-        DEPENDS "${binding_TARGET}_SOURCES"
-        SOURCE_DIR "${PROJECT_SOURCE_DIR}"
-        BINARY_DIR "${PROJECT_BINARY_DIR}"
-    )
-    set_target_properties("${binding_TARGET}_REBUILD" PROPERTIES EXCLUDE_FROM_ALL TRUE)
-    add_dependencies("${binding_TARGET}" "${binding_TARGET}_REBUILD")
+    if(binding_SINGLE_PASS)
+        # The generated sources are compiled after chimera has run.
+        set(binding_GENERATOR_TARGET "${binding_TARGET}_SOURCES")
+    else()
+        # Trigger the rebuild of the library target after new sources have been
+        # generated, since placeholder dependencies invalidated by chimera
+        # cause CMake to rerun the compilation of the library.
+        #
+        # For BUILD_COMMAND, '$(MAKE)' is used instead of 'make' to propagate
+        # the make commands of the parent project to the child process.
+        # (see: http://stackoverflow.com/a/33171336)
+        ExternalProject_Add("${binding_TARGET}_REBUILD"
+            DOWNLOAD_COMMAND ""
+            INSTALL_COMMAND ""
+            BUILD_COMMAND $(MAKE) "${binding_TARGET}_SOURCES"
+            DEPENDS "${binding_TARGET}_SOURCES"
+            SOURCE_DIR "${PROJECT_SOURCE_DIR}"
+            BINARY_DIR "${PROJECT_BINARY_DIR}"
+        )
+        set_target_properties("${binding_TARGET}_REBUILD" PROPERTIES EXCLUDE_FROM_ALL TRUE)
+        set(binding_GENERATOR_TARGET "${binding_TARGET}_REBUILD")
+    endif()
+    add_dependencies("${binding_TARGET}" "${binding_GENERATOR_TARGET}")
+
+    # Every generated binding includes the prelude header first, so precompile
+    # it for the module.  Older versions of CMake cannot do this natively, in
+    # which case the prelude is parsed by every binding.
+    set_source_files_properties("${binding_PRELUDE}" PROPERTIES GENERATED TRUE)
+    if(COMMAND target_precompile_headers)
+        target_precompile_headers("${binding_TARGET}" PRIVATE "${binding_PRELUDE}")
+        set_source_files_properties("${binding_EMPTY_CPP}" ${binding_EXTRA_SOURCES}
+            PROPERTIES SKIP_PRECOMPILE_HEADERS ON
+        )
+    endif()
 
 endfunction(add_chimera_binding)
@@ -11,6 +11,7 @@ file(READ "${BINDING_PATH}/enum.cpp.tmpl" BINDING_ENUM_CPP)
 file(READ "${BINDING_PATH}/function.cpp.tmpl" BINDING_FUNCTION_CPP)
 file(READ "${BINDING_PATH}/variable.cpp.tmpl" BINDING_VARIABLE_CPP)
 file(READ "${BINDING_PATH}/module.cpp.tmpl" BINDING_MODULE_CPP)
+file(READ "${BINDING_PATH}/prelude.h.tmpl" BINDING_PRELUDE_H)
 
 # Uses a binding template to assemble the above files into a header.
 configure_file("${BINDING_TEMPLATE}" "${BINDING_OUTPUT}"
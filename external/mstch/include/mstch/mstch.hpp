@@ -1,10 +1,14 @@
 #pragma once
 
+#include <atomic>
 #include <vector>
 #include <map>
 #include <string>
 #include <memory>
 #include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <boost/variant.hpp>
 
@@ -14,20 +18,153 @@ struct config {
   static std::function<std::string(const std::string&)> escape;
 };
 
+////////////////////////////
+// MODIFIED FOR CHIMERA
+////////////////////////////
+
+// Process-wide counters of memoized object method lookups.
+struct memoization_stats {
+  // Lookups that were answered from the cache.
+  static std::atomic<unsigned long> hits;
+  // Lookups of memoized methods that had to be computed.
+  static std::atomic<unsigned long> misses;
+};
+
+////////////////////////////
+// END MODIFIED FOR CHIMERA
+////////////////////////////
+
 namespace internal {
 
+////////////////////////////
+// MODIFIED FOR CHIMERA
+////////////////////////////
+
+// Identifier of an interned key name. Template tokens intern their key names
+// when the template is compiled, so that object lookups while rendering hash
+// an integer instead of comparing strings. Interning is thread-safe, and a
+// name always maps to the same symbol for the lifetime of the process.
+using symbol = std::size_t;
+symbol intern(const std::string& name);
+
+// Returns the name of an interned symbol.
+const std::string& name_of(symbol name);
+
+////////////////////////////
+// END MODIFIED FOR CHIMERA
+////////////////////////////
+
 template<class N>
 class object_t {
  public:
+  ////////////////////////////
+  // MODIFIED FOR CHIMERA
+  ////////////////////////////
+
+  // A set of methods that is shared by all objects of the same type, so that
+  // constructing an object does not need to register each method again.
+  // Tables of derived types are usually built by copying the table of their
+  // base type and adding or replacing entries.
+  class method_table {
+   public:
+    using function = std::function<N(object_t&)>;
+
+    template<class S>
+    method_table& add(const std::string& name, N (S::*method)()) {
+      return add(name, [method](object_t& object) {
+        return (static_cast<S&>(object).*method)();
+      });
+    }
+
+    method_table& add(const std::string& name, function func) {
+      m_methods[intern(name)].func = std::move(func);
+      return *this;
+    }
+
+    // Cache the values of the named methods in each object the first time
+    // they are looked up. See object_t::memoize_methods().
+    method_table& memoize(std::initializer_list<std::string> names) {
+      for (auto& name: names)
+        m_methods.at(intern(name)).memoized = true;
+      return *this;
+    }
+
+   private:
+    struct entry {
+      function func;
+      bool memoized = false;
+    };
+    std::unordered_map<symbol, entry> m_methods;
+    friend class object_t;
+  };
+
   const N& at(const std::string& name) const {
-    cache[name] = (methods.at(name))();
-    return cache[name];
+    return at(intern(name));
+  }
+
+  const N& at(symbol name) const {
+    // Methods from the shared table take precedence over methods that were
+    // registered on this object.
+    if (table) {
+      auto it = table->m_methods.find(name);
+      if (it != table->m_methods.end())
+        return evaluate(name, it->second.memoized, [this, it]() {
+          return it->second.func(const_cast<object_t&>(*this));
+        });
+    }
+
+    // Constants are only used for names without a registered method.
+    if (constants && methods.count(name) == 0) {
+      auto it = constants->find(name);
+      if (it != constants->end())
+        return it->second;
+    }
+
+    auto& method = methods.at(name);
+    return evaluate(name, memoize_all || memoized.count(name) != 0, method);
   }
 
-  bool has(const std::string name) const {
-    return methods.count(name) != 0;
+  bool has(const std::string& name) const {
+    return has(intern(name));
   }
 
+  bool has(symbol name) const {
+    return has_method(name) || (constants && constants->count(name) != 0);
+  }
+
+  // Names of all values that can be looked up in this object, in no
+  // particular order.
+  std::vector<symbol> keys() const {
+    std::vector<symbol> result;
+    if (table)
+      for (auto& it: table->m_methods)
+        result.push_back(it.first);
+    for (auto& it: methods)
+      if (!table || table->m_methods.count(it.first) == 0)
+        result.push_back(it.first);
+    if (constants)
+      for (auto& it: *constants)
+        if (!has_method(it.first))
+          result.push_back(it.first);
+    return result;
+  }
+
+  // Values that do not depend on the object, e.g. entries of a configuration
+  // file. They can be shared by many objects, since they are never modified.
+  using constant_map = std::unordered_map<symbol, N>;
+
+  static std::shared_ptr<const constant_map> make_constants(
+      const std::map<const std::string, N>& values) {
+    auto constants = std::make_shared<constant_map>();
+    for (auto& item: values)
+      constants->emplace(intern(item.first), item.second);
+    return constants;
+  }
+
+  ////////////////////////////
+  // END MODIFIED FOR CHIMERA
+  ////////////////////////////
+
  protected:
   ////////////////////////////
   // MODIFIED FOR CHIMERA
@@ -38,13 +175,52 @@ class object_t {
     for(auto& item: methods)
       // This is a modification to the original mstch implementation that allows
       // to override methods.
-      this->methods[item.first] = std::bind(item.second, s);
+      this->methods[intern(item.first)] = std::bind(item.second, s);
   }
 
   // This is a modification to the original mstch implementation that allows
   // registration of non-member (static or global) functions on mstch::object.
   void register_lambda(std::string name, std::function<N()> func) {
-    this->methods[name] = func;
+    this->methods[intern(name)] = func;
+  }
+
+  // Use a shared table of methods for this object. The table must outlive
+  // the object, and its entries take precedence over registered methods.
+  void set_method_table(const method_table& table) {
+    this->table = &table;
+  }
+
+  // Use a shared set of constant values for this object, which is looked up
+  // after the methods of the object.
+  void set_constants(std::shared_ptr<const constant_map> constants) {
+    this->constants = std::move(constants);
+  }
+
+  // Cache the values of the named methods the first time they are looked up,
+  // so that they are not recomputed for every reference in a template. This
+  // is only safe for methods whose values do not change during rendering.
+  void memoize_methods(std::initializer_list<std::string> names) {
+    for (auto& name: names)
+      memoized.insert(intern(name));
+  }
+
+  // Cache the values of all methods of this object.
+  void memoize_all_methods() {
+    memoize_all = true;
+  }
+
+  // Hold the given mutex while computing the value of any method of this
+  // object, for methods that access state which is not thread-safe. The
+  // mutex is recursive, since methods may look up the methods of other
+  // objects, and should be shared by the objects that access the same state.
+  // The cached values are guarded by a separate mutex of this object, which
+  // is only held while the cache is accessed, so that cached values can be
+  // looked up while another thread computes a value. The values of all
+  // methods are cached, since a reference to a value must not be overwritten
+  // while another thread renders it.
+  void synchronize(std::recursive_mutex& mutex) {
+    this->mutex = &mutex;
+    cache_mutex = std::make_shared<std::mutex>();
   }
 
   ////////////////////////////
@@ -52,8 +228,75 @@ class object_t {
   ////////////////////////////
 
  private:
-  std::map<std::string, std::function<N()>> methods;
-  mutable std::map<std::string, N> cache;
+  // MODIFIED FOR CHIMERA
+  bool has_method(symbol name) const {
+    return (table && table->m_methods.count(name) != 0) ||
+        methods.count(name) != 0;
+  }
+
+  // MODIFIED FOR CHIMERA
+  // This is a modification to the original mstch implementation, which
+  // wrote into the cache but never read from it. Memoized methods are
+  // evaluated at most once per object.
+  //
+  // The cache of a synchronized object is only accessed while its cache
+  // mutex is held, which is never held while a value is computed, since the
+  // computation may look up other methods of this object. The given mutex
+  // is only held while a value is computed. Values are never overwritten,
+  // and the nodes of the cache are stable, so references to them stay valid
+  // after the cache mutex is released.
+  template<class F>
+  const N& evaluate(symbol name, bool memoize, const F& compute) const {
+    if (mutex) {
+      {
+        std::lock_guard<std::mutex> cache_lock(*cache_mutex);
+        auto it = cache.find(name);
+        if (it != cache.end()) {
+          ++memoization_stats::hits;
+          return it->second;
+        }
+      }
+
+      // Another thread may have computed the value while this one waited.
+      std::lock_guard<std::recursive_mutex> lock(*mutex);
+      {
+        std::lock_guard<std::mutex> cache_lock(*cache_mutex);
+        auto it = cache.find(name);
+        if (it != cache.end()) {
+          ++memoization_stats::hits;
+          return it->second;
+        }
+      }
+      ++memoization_stats::misses;
+      N value = compute();
+      std::lock_guard<std::mutex> cache_lock(*cache_mutex);
+      return cache.emplace(name, std::move(value)).first->second;
+    }
+
+    if (memoize) {
+      auto it = cache.find(name);
+      if (it != cache.end()) {
+        ++memoization_stats::hits;
+        return it->second;
+      }
+      ++memoization_stats::misses;
+      return cache.emplace(name, compute()).first->second;
+    }
+
+    N& value = cache[name];
+    value = compute();
+    return value;
+  }
+
+  // MODIFIED FOR CHIMERA: methods are keyed by interned symbols.
+  const method_table* table = nullptr;
+  std::unordered_map<symbol, std::function<N()>> methods;
+  std::shared_ptr<const constant_map> constants;
+  mutable std::unordered_map<symbol, N> cache;
+  std::unordered_set<symbol> memoized;
+  bool memoize_all = false;
+  std::recursive_mutex* mutex = nullptr;
+  std::shared_ptr<std::mutex> cache_mutex;
 };
 
 template<class T, class N>
@@ -126,4 +369,95 @@ std::string render(
     const std::map<std::string,std::string>& partials =
         std::map<std::string,std::string>());
 
+////////////////////////////
+// MODIFIED FOR CHIMERA
+////////////////////////////
+
+class template_type;
+class render_context;
+struct key_segment;
+
+// Destination of rendered output. Rendering into a sink writes each piece of
+// output as it is produced, instead of accumulating the result in a string.
+class output_sink {
+ public:
+  virtual ~output_sink() {}
+  virtual void write(const char* data, std::size_t size) = 0;
+  void write(const std::string& str) { write(str.data(), str.size()); }
+};
+
+namespace aot {
+
+// Runtime for templates that were compiled ahead of time into C++ functions
+// by the mstch_compile tool. Compiled templates produce the same output as
+// the interpreter, but do not tokenize or walk tokens at render time.
+
+// A dotted key name that is split and interned once.
+class key {
+ public:
+  explicit key(const std::string& name);
+  const std::vector<key_segment>& path() const { return *m_path; }
+
+ private:
+  std::shared_ptr<const std::vector<key_segment>> m_path;
+};
+
+class context;
+using render_function = void (*)(context&);
+
+// Rendering state that is passed to compiled template functions.
+class context {
+ public:
+  context(render_context& ctx, output_sink& out);
+  void text(const char* data, std::size_t size) { m_out.write(data, size); }
+  void variable(const key& name, bool escape);
+  // The source text and delimiters of a section are only used if the section
+  // refers to a lambda, which receives the unrendered section text.
+  void section(
+      const key& name,
+      render_function body,
+      const char* source,
+      const char* open_delim,
+      const char* close_delim);
+  void inverted(const key& name, render_function body);
+  output_sink& sink() { return m_out; }
+
+ private:
+  render_context& m_ctx;
+  output_sink& m_out;
+};
+
+}
+
+// A template that is tokenized and whitespace-stripped once on construction,
+// so that it can be rendered many times without being parsed again. It can
+// also wrap a template that was compiled ahead of time.
+class compiled_template {
+ public:
+  compiled_template();
+  compiled_template(const std::string& tmplt);
+  compiled_template(aot::render_function function);
+  const template_type& get() const { return *m_template; }
+  aot::render_function function() const { return m_function; }
+
+ private:
+  std::shared_ptr<const template_type> m_template;
+  aot::render_function m_function;
+};
+
+std::string render(const compiled_template& tmplt, const node& root);
+
+void render(
+    const compiled_template& tmplt,
+    const node& root,
+    output_sink& out);
+
+// Returns whether a node would be treated as empty (falsy) by a section, so
+// that callers can test a value without rendering a template.
+bool is_empty(const node& n);
+
+////////////////////////////
+// END MODIFIED FOR CHIMERA
+////////////////////////////
+
 }
@@ -0,0 +1,109 @@
+// MODIFIED FOR CHIMERA
+// Runtime support for templates that were compiled ahead of time into C++
+// functions by mstch_compile. Each function here mirrors the corresponding
+// render state or visitor of the interpreter, so that both produce the same
+// output.
+
+#include "mstch/mstch.hpp"
+#include "render_context.hpp"
+#include "token.hpp"
+#include "visitor/is_node_empty.hpp"
+#include "visitor/render_node.hpp"
+
+using namespace mstch;
+
+namespace {
+
+// Compiled counterpart of the render_section visitor.
+class render_compiled_section: public boost::static_visitor<void> {
+ public:
+  enum class flag { none, keep_array };
+  render_compiled_section(
+      render_context& ctx,
+      aot::context& compiled_ctx,
+      aot::render_function body,
+      const std::string& source,
+      const delim_type& delims,
+      flag p_flag = flag::none):
+      m_ctx(ctx), m_compiled_ctx(compiled_ctx), m_body(body),
+      m_source(source), m_delims(delims), m_flag(p_flag)
+  {
+  }
+
+  // The pushed node must outlive the body, unlike in render_section where
+  // the temporary node lives until the end of the rendering expression.
+  template<class T>
+  void operator()(const T& t) const {
+    const mstch::node node{t};
+    render_context::push push(m_ctx, node);
+    m_body(m_compiled_ctx);
+  }
+
+  void operator()(const lambda& fun) const {
+    template_type interpreted{fun([this](const mstch::node& n) {
+      string_sink rendered;
+      visit(render_node(m_ctx, rendered), n);
+      return rendered.str();
+    }, m_source), m_delims};
+    render_context::push(m_ctx).render(interpreted, m_compiled_ctx.sink());
+  }
+
+  void operator()(const array& array) const {
+    if (m_flag == flag::keep_array) {
+      const mstch::node node{array};
+      render_context::push push(m_ctx, node);
+      m_body(m_compiled_ctx);
+    } else
+      for (auto& item: array)
+        visit(render_compiled_section(
+            m_ctx, m_compiled_ctx, m_body, m_source, m_delims,
+            flag::keep_array), item);
+  }
+
+ private:
+  render_context& m_ctx;
+  aot::context& m_compiled_ctx;
+  aot::render_function m_body;
+  const std::string& m_source;
+  const delim_type& m_delims;
+  flag m_flag;
+};
+
+}
+
+aot::key::key(const std::string& name): m_path(make_key_path(name)) {
+}
+
+aot::context::context(render_context& ctx, output_sink& out):
+    m_ctx(ctx), m_out(out)
+{
+}
+
+void aot::context::variable(const key& name, bool escape) {
+  using flag = render_node::flag;
+  visit(render_node(m_ctx, m_out, escape ? flag::escape_html : flag::none),
+      m_ctx.get_node(name.path()));
+}
+
+void aot::context::section(
+    const key& name,
+    render_function body,
+    const char* source,
+    const char* open_delim,
+    const char* close_delim)
+{
+  auto& node = m_ctx.get_node(name.path());
+  if (!visit(is_node_empty(), node)) {
+    const std::string source_str{source};
+    const delim_type delims{open_delim, close_delim};
+    visit(render_compiled_section(
+        m_ctx, *this, body, source_str, delims), node);
+  }
+}
+
+void aot::context::inverted(const key& name, render_function body) {
+  if (visit(is_node_empty(), m_ctx.get_node(name.path()))) {
+    render_context::push push(m_ctx);
+    body(*this);
+  }
+}
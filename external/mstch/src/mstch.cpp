@@ -1,12 +1,50 @@
 #include <iostream>
+#include <mutex>
 
 #include "mstch/mstch.hpp"
 #include "render_context.hpp"
+#include "visitor/is_node_empty.hpp"
 
 using namespace mstch;
 
 std::function<std::string(const std::string&)> mstch::config::escape;
 
+// MODIFIED FOR CHIMERA
+std::atomic<unsigned long> mstch::memoization_stats::hits{0};
+std::atomic<unsigned long> mstch::memoization_stats::misses{0};
+
+namespace {
+
+// MODIFIED FOR CHIMERA
+struct symbol_table {
+  std::mutex mutex;
+  std::unordered_map<std::string, mstch::internal::symbol> symbols;
+  // Names of the symbols, which point into the keys of `symbols`.
+  std::vector<const std::string*> names;
+};
+
+symbol_table& get_symbol_table() {
+  static symbol_table table;
+  return table;
+}
+
+}
+
+mstch::internal::symbol mstch::internal::intern(const std::string& name) {
+  auto& table = get_symbol_table();
+  std::lock_guard<std::mutex> lock(table.mutex);
+  auto result = table.symbols.emplace(name, table.symbols.size());
+  if (result.second)
+    table.names.push_back(&result.first->first);
+  return result.first->second;
+}
+
+const std::string& mstch::internal::name_of(symbol name) {
+  auto& table = get_symbol_table();
+  std::lock_guard<std::mutex> lock(table.mutex);
+  return *table.names.at(name);
+}
+
 std::string mstch::render(
     const std::string& tmplt,
     const node& root,
@@ -18,3 +56,41 @@ std::string mstch::render(
 
   return render_context(root, partial_templates).render(tmplt);
 }
+
+mstch::compiled_template::compiled_template():
+    m_template(std::make_shared<template_type>()), m_function(nullptr)
+{
+}
+
+mstch::compiled_template::compiled_template(const std::string& tmplt):
+    m_template(std::make_shared<template_type>(tmplt)), m_function(nullptr)
+{
+}
+
+mstch::compiled_template::compiled_template(aot::render_function function):
+    m_template(std::make_shared<template_type>()), m_function(function)
+{
+}
+
+std::string mstch::render(const compiled_template& tmplt, const node& root) {
+  string_sink out;
+  render(tmplt, root, out);
+  return out.str();
+}
+
+void mstch::render(
+    const compiled_template& tmplt,
+    const node& root,
+    output_sink& out)
+{
+  render_context ctx(root, {});
+  if (tmplt.function()) {
+    aot::context compiled_ctx(ctx, out);
+    tmplt.function()(compiled_ctx);
+  } else
+    ctx.render(tmplt.get(), out);
+}
+
+bool mstch::is_empty(const node& n) {
+  return visit(is_node_empty(), n);
+}
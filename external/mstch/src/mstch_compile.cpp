@@ -0,0 +1,247 @@
+// MODIFIED FOR CHIMERA
+// Compiles mustache templates ahead of time into C++ render functions that
+// use the mstch::aot runtime.
+//
+// usage: mstch_compile [--pad-newlines] OUTPUT NAMESPACE NAME=FILE...
+//
+// Each FILE is compiled into a function `void NAME(mstch::aot::context&)` in
+// NAMESPACE (which may be nested, e.g. `a::b`). With --pad-newlines, each
+// template is surrounded by newlines before it is compiled, which matches how
+// templates are embedded as raw string literals.
+//
+// Sections are split exactly like the interpreter splits them, so that the
+// compiled functions produce the same output. Partials are not supported,
+// since compiled templates are rendered without any partials.
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "template_type.hpp"
+#include "token.hpp"
+
+using namespace mstch;
+
+namespace {
+
+std::string literal(const std::string& str) {
+  std::ostringstream out;
+  out << '"';
+  for (unsigned char c: str) {
+    switch (c) {
+      case '\n': out << "\\n"; break;
+      case '\t': out << "\\t"; break;
+      case '\r': out << "\\r"; break;
+      case '"': out << "\\\""; break;
+      case '\\': out << "\\\\"; break;
+      // Avoid accidental trigraphs.
+      case '?': out << "\\?"; break;
+      default:
+        if (c < 0x20 || c >= 0x7f) {
+          static const char* digits = "01234567";
+          out << '\\' << digits[(c >> 6) & 7] << digits[(c >> 3) & 7]
+              << digits[c & 7];
+        } else
+          out << c;
+    }
+  }
+  out << '"';
+  return out.str();
+}
+
+class compiler {
+ public:
+  // Emits the section functions of a template into an anonymous namespace
+  // and returns the body of its top-level function.
+  std::string compile(const std::string& name, const template_type& tmplt) {
+    std::vector<token> tokens(tmplt.begin(), tmplt.end());
+    return compile_tokens(name, tokens);
+  }
+
+  void write_keys(std::ostream& out) const {
+    for (auto& key: m_key_order)
+      out << "const ::mstch::aot::key " << m_keys.at(key) << "{"
+          << literal(key) << "};\n";
+  }
+
+  const std::string& functions() const { return m_functions; }
+
+ private:
+  std::map<std::string, std::string> m_keys;
+  std::vector<std::string> m_key_order;
+  std::string m_functions;
+  int m_sections = 0;
+
+  const std::string& key(const std::string& name) {
+    auto it = m_keys.find(name);
+    if (it == m_keys.end()) {
+      it = m_keys.emplace(name, "key_" + std::to_string(m_keys.size())).first;
+      m_key_order.push_back(name);
+    }
+    return it->second;
+  }
+
+  // Mirrors outside_section and in_section: a section is closed by the first
+  // closing tag with the same name that is not balanced by a nested opening
+  // tag, and an unclosed section renders nothing.
+  std::string compile_tokens(
+      const std::string& name, const std::vector<token>& tokens)
+  {
+    std::ostringstream body;
+    std::string text;
+    auto flush_text = [&]() {
+      if (!text.empty())
+        body << "  ctx.text(" << literal(text) << ", " << text.size()
+             << ");\n";
+      text.clear();
+    };
+
+    for (std::size_t i = 0; i < tokens.size(); ++i) {
+      const token& tok = tokens[i];
+      switch (tok.token_type()) {
+        case token::type::text:
+          text += tok.raw();
+          break;
+        case token::type::variable:
+        case token::type::unescaped_variable:
+          flush_text();
+          body << "  ctx.variable(" << key(tok.name()) << ", "
+               << (tok.token_type() == token::type::variable ? "true" : "false")
+               << ");\n";
+          break;
+        case token::type::section_open:
+        case token::type::inverted_section_open: {
+          std::vector<token> section;
+          int skipped_openings = 0;
+          bool closed = false;
+          for (++i; i < tokens.size(); ++i) {
+            const token& inner = tokens[i];
+            if (inner.token_type() == token::type::section_close) {
+              if (inner.name() == tok.name() && skipped_openings == 0) {
+                closed = true;
+                break;
+              } else
+                skipped_openings--;
+            } else if (
+                inner.token_type() == token::type::inverted_section_open ||
+                inner.token_type() == token::type::section_open)
+              skipped_openings++;
+            section.push_back(inner);
+          }
+          if (!closed)
+            break;
+
+          flush_text();
+          auto function = name + "_" + std::to_string(m_sections++);
+          auto function_body = compile_tokens(function, section);
+          m_functions += "void " + function +
+              "(::mstch::aot::context& ctx) {\n" + function_body + "}\n\n";
+
+          if (tok.token_type() == token::type::section_open) {
+            std::string source;
+            for (auto& inner: section)
+              source += inner.raw();
+            body << "  ctx.section(" << key(tok.name()) << ", " << function
+                 << ",\n      " << literal(source) << ", "
+                 << literal(tok.delims().first) << ", "
+                 << literal(tok.delims().second) << ");\n";
+          } else
+            body << "  ctx.inverted(" << key(tok.name()) << ", " << function
+                 << ");\n";
+          break;
+        }
+        case token::type::partial:
+          std::cerr << "mstch_compile: partials are not supported ({{>"
+                    << tok.name() << "}})" << std::endl;
+          exit(1);
+        default:
+          break;
+      }
+    }
+    flush_text();
+    return body.str();
+  }
+};
+
+}
+
+int main(int argc, char* argv[]) {
+  int arg = 1;
+  bool pad_newlines = false;
+  if (arg < argc && std::string(argv[arg]) == "--pad-newlines") {
+    pad_newlines = true;
+    arg++;
+  }
+  if (argc - arg < 3) {
+    std::cerr << "usage: mstch_compile [--pad-newlines] OUTPUT NAMESPACE "
+                 "NAME=FILE..." << std::endl;
+    return 1;
+  }
+
+  const std::string output_path = argv[arg++];
+  std::vector<std::string> namespaces;
+  {
+    const std::string ns = argv[arg++];
+    std::size_t begin = 0;
+    for (;;) {
+      auto end = ns.find("::", begin);
+      namespaces.push_back(ns.substr(begin, end - begin));
+      if (end == std::string::npos)
+        break;
+      begin = end + 2;
+    }
+  }
+
+  compiler comp;
+  std::ostringstream entry_points;
+  for (; arg < argc; ++arg) {
+    const std::string spec = argv[arg];
+    auto eq = spec.find('=');
+    if (eq == std::string::npos || eq == 0) {
+      std::cerr << "mstch_compile: expected NAME=FILE, got '" << spec << "'"
+                << std::endl;
+      return 1;
+    }
+    const std::string name = spec.substr(0, eq);
+    const std::string path = spec.substr(eq + 1);
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+      std::cerr << "mstch_compile: unable to read '" << path << "'"
+                << std::endl;
+      return 1;
+    }
+    std::stringstream contents;
+    contents << in.rdbuf();
+    std::string source = contents.str();
+    if (pad_newlines)
+      source = "\n" + source + "\n";
+
+    auto body = comp.compile(name, template_type{source});
+    entry_points << "void " << name << "(::mstch::aot::context& ctx) {\n"
+                 << body << "}\n\n";
+  }
+
+  std::ostringstream out;
+  out << "// This file was generated by mstch_compile. Do not edit.\n\n"
+      << "#include <mstch/mstch.hpp>\n\n";
+  for (auto& ns: namespaces)
+    out << "namespace " << ns << " {\n";
+  out << "\nnamespace {\n\n";
+  comp.write_keys(out);
+  out << "\n" << comp.functions() << "}\n\n" << entry_points.str();
+  for (auto it = namespaces.rbegin(); it != namespaces.rend(); ++it)
+    out << "} // namespace " << *it << "\n";
+
+  std::ofstream file(output_path, std::ios::binary);
+  file << out.str();
+  if (!file) {
+    std::cerr << "mstch_compile: unable to write '" << output_path << "'"
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
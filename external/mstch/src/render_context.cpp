@@ -1,6 +1,6 @@
 #include "render_context.hpp"
 #include "state/outside_section.hpp"
-#include "visitor/get_token.hpp"
+#include "visitor/find_token.hpp"
 
 using namespace mstch;
 
@@ -9,64 +9,71 @@ const mstch::node render_context::null_node;
 render_context::push::push(render_context& context, const mstch::node& node):
     m_context(context)
 {
-  context.m_nodes.emplace_front(node);
-  context.m_node_ptrs.emplace_front(&node);
+  context.m_node_ptrs.push_back(&node);
   context.m_state.push(std::unique_ptr<render_state>(new outside_section));
 }
 
 render_context::push::~push() {
-  m_context.m_nodes.pop_front();
-  m_context.m_node_ptrs.pop_front();
+  m_context.m_node_ptrs.pop_back();
   m_context.m_state.pop();
 }
 
-std::string render_context::push::render(const template_type& templt) {
-  return m_context.render(templt);
+void render_context::push::render(
+    const template_type& templt, output_sink& out)
+{
+  m_context.render(templt, out);
 }
 
 render_context::render_context(
     const mstch::node& node,
     const std::map<std::string, template_type>& partials):
-    m_partials(partials), m_nodes(1, node), m_node_ptrs(1, &node)
+    m_partials(partials), m_node_ptrs(1, &node)
 {
   m_state.push(std::unique_ptr<render_state>(new outside_section));
 }
 
-const mstch::node& render_context::find_node(
-    const std::string& token,
-    std::list<node const*> current_nodes)
-{
-  if (token != "." && token.find('.') != std::string::npos)
-    return find_node(token.substr(token.rfind('.') + 1),
-        {&find_node(token.substr(0, token.rfind('.')), current_nodes)});
-  else
-    for (auto& node: current_nodes)
-      if (visit(has_token(token), *node))
-        return visit(get_token(token, *node), *node);
-  return null_node;
+// MODIFIED FOR CHIMERA: dotted names are split when the template is compiled.
+// The first component is searched for from the innermost context outwards,
+// and each following component is looked up in the node found so far.
+const mstch::node& render_context::get_node(const token& token) {
+  return get_node(token.path());
+}
+
+const mstch::node& render_context::get_node(const key_path& path) {
+  const mstch::node* found = nullptr;
+  for (auto it = m_node_ptrs.rbegin(); it != m_node_ptrs.rend(); ++it)
+    if ((found = visit(find_token(path.front(), **it), **it)))
+      break;
+
+  for (std::size_t i = 1; found && i < path.size(); ++i)
+    found = visit(find_token(path[i], *found), *found);
+
+  return found ? *found : null_node;
 }
 
-const mstch::node& render_context::get_node(const std::string& token) {
-    return find_node(token, m_node_ptrs);
+std::string render_context::render(const template_type& templt) {
+  string_sink out;
+  render(templt, out);
+  return out.str();
 }
 
-std::string render_context::render(
-    const template_type& templt, const std::string& prefix)
+void render_context::render(
+    const template_type& templt, output_sink& out, const std::string& prefix)
 {
-  std::string output;
   bool prev_eol = true;
   for (auto& token: templt) {
     if (prev_eol && prefix.length() != 0)
-      output += m_state.top()->render(*this, {prefix});
-    output += m_state.top()->render(*this, token);
+      m_state.top()->render(*this, {prefix}, out);
+    m_state.top()->render(*this, token, out);
     prev_eol = token.eol();
   }
-  return output;
 }
 
-std::string render_context::render_partial(
-    const std::string& partial_name, const std::string& prefix)
+void render_context::render_partial(
+    const std::string& partial_name,
+    const std::string& prefix,
+    output_sink& out)
 {
-  return m_partials.count(partial_name) ?
-      render(m_partials.at(partial_name), prefix) : "";
+  if (m_partials.count(partial_name))
+    render(m_partials.at(partial_name), out, prefix);
 }
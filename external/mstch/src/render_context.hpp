@@ -1,10 +1,9 @@
 #pragma once
 
-#include <deque>
-#include <list>
 #include <sstream>
 #include <string>
 #include <stack>
+#include <vector>
 
 #include "mstch/mstch.hpp"
 #include "state/render_state.hpp"
@@ -12,13 +11,25 @@
 
 namespace mstch {
 
+// MODIFIED FOR CHIMERA: sink that collects the output into a string.
+class string_sink: public output_sink {
+ public:
+  void write(const char* data, std::size_t size) override {
+    m_str.append(data, size);
+  }
+  const std::string& str() const { return m_str; }
+
+ private:
+  std::string m_str;
+};
+
 class render_context {
  public:
   class push {
    public:
     push(render_context& context, const mstch::node& node = {});
     ~push();
-    std::string render(const template_type& templt);
+    void render(const template_type& templt, output_sink& out);
    private:
     render_context& m_context;
   };
@@ -26,11 +37,17 @@ class render_context {
   render_context(
       const mstch::node& node,
       const std::map<std::string, template_type>& partials);
-  const mstch::node& get_node(const std::string& token);
-  std::string render(
-      const template_type& templt, const std::string& prefix = "");
-  std::string render_partial(
-      const std::string& partial_name, const std::string& prefix);
+  const mstch::node& get_node(const token& token);
+  const mstch::node& get_node(const key_path& path);
+  std::string render(const template_type& templt);
+  void render(
+      const template_type& templt,
+      output_sink& out,
+      const std::string& prefix = "");
+  void render_partial(
+      const std::string& partial_name,
+      const std::string& prefix,
+      output_sink& out);
   template<class T, class... Args>
   void set_state(Args&& ... args) {
     m_state.top() = std::unique_ptr<render_state>(
@@ -39,12 +56,10 @@ class render_context {
 
  private:
   static const mstch::node null_node;
-  const mstch::node& find_node(
-      const std::string& token,
-      std::list<node const*> current_nodes);
   std::map<std::string, template_type> m_partials;
-  std::deque<mstch::node> m_nodes;
-  std::list<const mstch::node*> m_node_ptrs;
+  // MODIFIED FOR CHIMERA: the innermost context is at the back. The nodes
+  // are owned by the caller of push(), which outlives the pushed context.
+  std::vector<const mstch::node*> m_node_ptrs;
   std::stack<std::unique_ptr<render_state>> m_state;
 };
 
@@ -10,19 +10,22 @@ in_section::in_section(type type, const token& start_token):
 {
 }
 
-std::string in_section::render(render_context& ctx, const token& token) {
+void in_section::render(
+    render_context& ctx, const token& token, output_sink& out)
+{
   if (token.token_type() == token::type::section_close)
     if (token.name() == m_start_token.name() && m_skipped_openings == 0) {
-      auto& node = ctx.get_node(m_start_token.name());
-      std::string out;
+      auto& node = ctx.get_node(m_start_token);
 
       if (m_type == type::normal && !visit(is_node_empty(), node))
-        out = visit(render_section(ctx, m_section, m_start_token.delims()), node);
+        visit(render_section(
+            ctx, m_section, m_start_token.delims(), out), node);
       else if (m_type == type::inverted && visit(is_node_empty(), node))
-        out = render_context::push(ctx).render(m_section);
+        render_context::push(ctx).render(m_section, out);
 
+      // Note: this destroys the current state, so it must come last.
       ctx.set_state<outside_section>();
-      return out;
+      return;
     } else
       m_skipped_openings--;
   else if (token.token_type() == token::type::inverted_section_open ||
@@ -30,5 +33,4 @@ std::string in_section::render(render_context& ctx, const token& token) {
     m_skipped_openings++;
 
   m_section << token;
-  return "";
 }
@@ -6,8 +6,8 @@
 
 using namespace mstch;
 
-std::string outside_section::render(
-    render_context& ctx, const token& token)
+void outside_section::render(
+    render_context& ctx, const token& token, output_sink& out)
 {
   using flag = render_node::flag;
   switch (token.token_type()) {
@@ -18,15 +18,18 @@ std::string outside_section::render(
       ctx.set_state<in_section>(in_section::type::inverted, token);
       break;
     case token::type::variable:
-      return visit(render_node(ctx, flag::escape_html), ctx.get_node(token.name()));
+      visit(render_node(ctx, out, flag::escape_html), ctx.get_node(token));
+      break;
     case token::type::unescaped_variable:
-      return visit(render_node(ctx, flag::none), ctx.get_node(token.name()));
+      visit(render_node(ctx, out, flag::none), ctx.get_node(token));
+      break;
     case token::type::text:
-      return token.raw();
+      out.write(token.raw());
+      break;
     case token::type::partial:
-      return ctx.render_partial(token.name(), token.partial_prefix());
+      ctx.render_partial(token.name(), token.partial_prefix(), out);
+      break;
     default:
       break;
   }
-  return "";
 }
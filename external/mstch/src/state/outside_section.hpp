@@ -6,7 +6,8 @@ namespace mstch {
 
 class outside_section: public render_state {
  public:
-  std::string render(render_context& context, const token& token) override;
+  void render(
+      render_context& context, const token& token, output_sink& out) override;
 };
 
 }
@@ -2,6 +2,7 @@
 
 #include <memory>
 
+#include "mstch/mstch.hpp"
 #include "token.hpp"
 
 namespace mstch {
@@ -11,7 +12,9 @@ class render_context;
 class render_state {
  public:
   virtual ~render_state() {}
-  virtual std::string render(render_context& context, const token& token) = 0;
+  // MODIFIED FOR CHIMERA: output is written to a sink instead of returned.
+  virtual void render(
+      render_context& context, const token& token, output_sink& out) = 0;
 };
 
 }
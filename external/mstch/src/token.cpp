@@ -3,6 +3,26 @@
 
 using namespace mstch;
 
+// MODIFIED FOR CHIMERA
+// The implicit iterator "." is not split.
+std::shared_ptr<const key_path> mstch::make_key_path(const std::string& name) {
+  auto path = std::make_shared<key_path>();
+  if (name == ".") {
+    path->push_back({name, internal::intern(name)});
+    return path;
+  }
+
+  std::size_t begin = 0;
+  for (;;) {
+    auto end = name.find('.', begin);
+    auto segment = name.substr(begin, end - begin);
+    path->push_back({segment, internal::intern(segment)});
+    if (end == std::string::npos)
+      return path;
+    begin = end + 1;
+  }
+}
+
 token::type token::token_info(char c) {
   switch (c) {
     case '>': return type::partial;
@@ -39,4 +59,18 @@ token::token(const std::string& str, std::size_t left, std::size_t right):
     m_eol = (str.size() > 0 && str[str.size() - 1] == '\n');
     m_ws_only = (str.find_first_not_of(" \r\n\t") == std::string::npos);
   }
+
+  ////////////////////////////
+  // MODIFIED FOR CHIMERA
+  ////////////////////////////
+
+  // Pre-split dotted names so that they do not need to be parsed again every
+  // time the token is rendered.
+  if (m_type == type::variable || m_type == type::unescaped_variable ||
+      m_type == type::section_open || m_type == type::inverted_section_open)
+    m_path = make_key_path(m_name);
+
+  ////////////////////////////
+  // END MODIFIED FOR CHIMERA
+  ////////////////////////////
 }
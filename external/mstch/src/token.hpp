@@ -1,11 +1,25 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <vector>
+
+#include "mstch/mstch.hpp"
 
 namespace mstch {
 
 using delim_type = std::pair<std::string, std::string>;
 
+// MODIFIED FOR CHIMERA: one component of a dotted key such as `class.type`.
+struct key_segment {
+  std::string name;
+  internal::symbol id;
+};
+using key_path = std::vector<key_segment>;
+
+// Splits a dotted key name into interned segments.
+std::shared_ptr<const key_path> make_key_path(const std::string& name);
+
 class token {
  public:
   enum class type {
@@ -16,6 +30,8 @@ class token {
   type token_type() const { return m_type; };
   const std::string& raw() const { return m_raw; };
   const std::string& name() const { return m_name; };
+  // Only available for variable and section opening tokens.
+  const key_path& path() const { return *m_path; };
   const std::string& partial_prefix() const { return m_partial_prefix; };
   const delim_type& delims() const { return m_delims; };
   void partial_prefix(const std::string& p_partial_prefix) {
@@ -33,6 +49,9 @@ class token {
   delim_type m_delims;
   bool m_eol;
   bool m_ws_only;
+  // MODIFIED FOR CHIMERA: the name split at dots and interned on construction.
+  // This is shared so that copying tokens into sections stays cheap.
+  std::shared_ptr<const key_path> m_path;
   type token_info(char c);
 };
 
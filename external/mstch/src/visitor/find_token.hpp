@@ -0,0 +1,39 @@
+#pragma once
+
+#include <boost/variant/static_visitor.hpp>
+
+#include "mstch/mstch.hpp"
+#include "token.hpp"
+
+namespace mstch {
+
+// MODIFIED FOR CHIMERA: this replaces the separate has_token and get_token
+// visitors, so that a key is only looked up once. It returns nullptr if the
+// node does not contain the key.
+class find_token: public boost::static_visitor<const mstch::node*> {
+ public:
+  find_token(const key_segment& key, const mstch::node& node):
+      m_key(key), m_node(node)
+  {
+  }
+
+  template<class T>
+  const mstch::node* operator()(const T&) const {
+    return m_key.name == "." ? &m_node : nullptr;
+  }
+
+  const mstch::node* operator()(const map& map) const {
+    auto it = map.find(m_key.name);
+    return it != map.end() ? &it->second : nullptr;
+  }
+
+  const mstch::node* operator()(const std::shared_ptr<object>& object) const {
+    return object->has(m_key.id) ? &object->at(m_key.id) : nullptr;
+  }
+
+ private:
+  const key_segment& m_key;
+  const mstch::node& m_node;
+};
+
+}
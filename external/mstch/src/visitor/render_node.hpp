@@ -9,47 +9,57 @@
 
 namespace mstch {
 
-class render_node: public boost::static_visitor<std::string> {
+// MODIFIED FOR CHIMERA: nodes are rendered directly into an output sink.
+class render_node: public boost::static_visitor<void> {
  public:
   enum class flag { none, escape_html };
-  render_node(render_context& ctx, flag p_flag = flag::none):
-      m_ctx(ctx), m_flag(p_flag)
+  render_node(render_context& ctx, output_sink& out, flag p_flag = flag::none):
+      m_ctx(ctx), m_out(out), m_flag(p_flag)
   {
   }
 
   template<class T>
-  std::string operator()(const T&) const {
-    return "";
+  void operator()(const T&) const {
   }
 
-  std::string operator()(const int& value) const {
-    return std::to_string(value);
+  void operator()(const int& value) const {
+    m_out.write(std::to_string(value));
   }
 
-  std::string operator()(const double& value) const {
+  void operator()(const double& value) const {
     std::stringstream ss;
     ss << value;
-    return ss.str();
+    m_out.write(ss.str());
   }
 
-  std::string operator()(const bool& value) const {
-    return value ? "true" : "false";
+  void operator()(const bool& value) const {
+    m_out.write(value ? "true" : "false", value ? 4 : 5);
   }
 
-  std::string operator()(const lambda& value) const {
+  void operator()(const lambda& value) const {
     template_type interpreted{value([this](const mstch::node& n) {
-      return visit(render_node(m_ctx), n);
+      string_sink rendered;
+      visit(render_node(m_ctx, rendered), n);
+      return rendered.str();
     })};
-    auto rendered = render_context::push(m_ctx).render(interpreted);
-    return (m_flag == flag::escape_html) ? html_escape(rendered) : rendered;
+    if (m_flag == flag::escape_html) {
+      string_sink rendered;
+      render_context::push(m_ctx).render(interpreted, rendered);
+      m_out.write(html_escape(rendered.str()));
+    } else
+      render_context::push(m_ctx).render(interpreted, m_out);
   }
 
-  std::string operator()(const std::string& value) const {
-    return (m_flag == flag::escape_html) ? html_escape(value) : value;
+  void operator()(const std::string& value) const {
+    if (m_flag == flag::escape_html)
+      m_out.write(html_escape(value));
+    else
+      m_out.write(value);
   }
 
  private:
   render_context& m_ctx;
+  output_sink& m_out;
   flag m_flag;
 };
 
@@ -9,48 +9,52 @@
 
 namespace mstch {
 
-class render_section: public boost::static_visitor<std::string> {
+// MODIFIED FOR CHIMERA: sections are rendered directly into an output sink.
+class render_section: public boost::static_visitor<void> {
  public:
   enum class flag { none, keep_array };
   render_section(
       render_context& ctx,
       const template_type& section,
       const delim_type& delims,
+      output_sink& out,
       flag p_flag = flag::none):
-      m_ctx(ctx), m_section(section), m_delims(delims), m_flag(p_flag)
+      m_ctx(ctx), m_section(section), m_delims(delims), m_out(out),
+      m_flag(p_flag)
   {
   }
 
   template<class T>
-  std::string operator()(const T& t) const {
-    return render_context::push(m_ctx, t).render(m_section);
+  void operator()(const T& t) const {
+    render_context::push(m_ctx, t).render(m_section, m_out);
   }
 
-  std::string operator()(const lambda& fun) const {
+  void operator()(const lambda& fun) const {
     std::string section_str;
     for (auto& token: m_section)
       section_str += token.raw();
     template_type interpreted{fun([this](const mstch::node& n) {
-      return visit(render_node(m_ctx), n);
+      string_sink rendered;
+      visit(render_node(m_ctx, rendered), n);
+      return rendered.str();
     }, section_str), m_delims};
-    return render_context::push(m_ctx).render(interpreted);
+    render_context::push(m_ctx).render(interpreted, m_out);
   }
 
-  std::string operator()(const array& array) const {
-    std::string out;
+  void operator()(const array& array) const {
     if (m_flag == flag::keep_array)
-      return render_context::push(m_ctx, array).render(m_section);
+      render_context::push(m_ctx, array).render(m_section, m_out);
     else
       for (auto& item: array)
-        out += visit(render_section(
-            m_ctx, m_section, m_delims, flag::keep_array), item);
-    return out;
+        visit(render_section(
+            m_ctx, m_section, m_delims, m_out, flag::keep_array), item);
   }
 
  private:
   render_context& m_ctx;
   const template_type& m_section;
   const delim_type& m_delims;
+  output_sink& m_out;
   flag m_flag;
 };
 
@@ -3,6 +3,7 @@
 
 #include <map>
 #include <string>
+#include <mstch/mstch.hpp>
 
 namespace chimera
 {
@@ -18,7 +19,19 @@ struct Definition
     std::string enum_cpp;
     std::string function_cpp;
     std::string module_cpp;
+    std::string prelude_h;
     std::string variable_cpp;
+
+    /**
+     * Render functions that were compiled ahead of time from the templates
+     * above, or `nullptr` if the corresponding template must be interpreted.
+     */
+    ::mstch::aot::render_function class_render;
+    ::mstch::aot::render_function enum_render;
+    ::mstch::aot::render_function function_render;
+    ::mstch::aot::render_function module_render;
+    ::mstch::aot::render_function prelude_render;
+    ::mstch::aot::render_function variable_render;
 };
 
 /**
@@ -2,13 +2,19 @@
 #define __CHIMERA_CONFIGURATION_H__
 
 #include "chimera/binding.h"
+#include "chimera/eligibility.h"
 
+#include <condition_variable>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <clang/AST/DeclBase.h>
 #include <clang/AST/Mangle.h>
+#include <clang/Basic/SourceManager.h>
 #include <clang/Frontend/CompilerInstance.h>
+#include <llvm/ADT/DenseMap.h>
 #include <mstch/mstch.hpp>
 #include <yaml-cpp/yaml.h>
 
@@ -78,10 +84,97 @@ public:
     void AddSourcePath(const std::string &sourcePath);
 
     /**
-     * Process the configuration settings against the current AST.
+     * Set the number of threads that are used to parse the sources and to
+     * render bindings.  If unspecified, the default is 1, which parses and
+     * renders on the calling thread.
      */
-    std::unique_ptr<CompiledConfiguration> Process(
-        clang::CompilerInstance *ci) const;
+    void SetJobs(unsigned jobs);
+
+    /**
+     * Set the number of shard files that the bindings are packed into.
+     * If unspecified, the default is 0, which generates one file per binding.
+     */
+    void SetShards(unsigned shards);
+
+    /**
+     * Set whether each binding only includes the files that it requires,
+     * instead of every source file.  If unspecified, the default is false.
+     */
+    void SetMinimalIncludes(bool minimal);
+
+    /**
+     * Set whether bindings whose fingerprint did not change since the last
+     * run are skipped instead of rendered.  Bindings that are packed into
+     * shards are always rendered, and only the shards whose bindings did not
+     * change are skipped.  If unspecified, the default is false.
+     */
+    void SetIncremental(bool incremental);
+
+    /**
+     * Set the directory in which the precompiled preambles of the sources
+     * are cached between runs.  If unspecified, the default is empty, which
+     * parses every source from scratch.
+     */
+    void SetPreambleCachePath(const std::string &path);
+
+    /**
+     * Add a file that the generated bindings depend on, but which is not
+     * loaded by the source manager, such as a file of a precompiled preamble.
+     */
+    void AddDependency(const std::string &path);
+
+    /**
+     * Set the number of translation units that are processed.  If
+     * unspecified, the default is a single translation unit.
+     */
+    void SetTranslationUnits(unsigned count);
+
+    /**
+     * Reserves up to the given number of threads in addition to the calling
+     * one, without exceeding the configured number of jobs, and returns the
+     * number of threads that were reserved.  This never blocks.
+     */
+    unsigned ReserveThreads(unsigned count) const;
+
+    /**
+     * Returns threads that were reserved by ReserveThreads().
+     */
+    void ReleaseThreads(unsigned count) const;
+
+    /**
+     * Waits until every translation unit before the given one has been
+     * traversed, and returns whether the given one should be traversed, which
+     * is not the case if it was already traversed.
+     *
+     * Translation units are traversed one at a time in the order of their
+     * sources, so that each binding is generated by the first translation
+     * unit that contains it, regardless of which one is parsed first.
+     */
+    bool BeginTraversal(unsigned index);
+
+    /**
+     * Marks a translation unit as traversed, which may be done more than
+     * once, such as when it failed to parse.
+     */
+    void EndTraversal(unsigned index);
+
+    /**
+     * Process the configuration settings against the AST of the translation
+     * unit with the given index.
+     */
+    std::unique_ptr<CompiledConfiguration> Process(clang::CompilerInstance *ci,
+                                                   unsigned index = 0) const;
+
+    /**
+     * Render the shards, the prelude header and the top-level module from
+     * the bindings of every translation unit, and print the filenames of
+     * the files that were generated by each translation unit in the order
+     * of their sources.
+     *
+     * This must be called once every translation unit has been processed,
+     * and does nothing if none of them was.
+     */
+    void RenderModule();
 
     /**
      * Get the root node of the YAML configuration structure.
@@ -103,9 +196,81 @@ public:
      */
     const std::string &GetOutputModuleName() const;
 
+    /**
+     * Get the number of threads that are used to parse the sources and to
+     * render bindings.
+     */
+    unsigned GetJobs() const;
+
+    /**
+     * Get the number of shard files that the bindings are packed into, or 0
+     * if each binding is generated into its own file.
+     */
+    unsigned GetShards() const;
+
+    /**
+     * Get whether each binding only includes the files that it requires.
+     */
+    bool GetMinimalIncludes() const;
+
+    /**
+     * Get whether bindings whose fingerprint did not change are skipped.
+     */
+    bool GetIncremental() const;
+
+    /**
+     * Get the directory in which precompiled preambles are cached, or an
+     * empty string if they are not cached.
+     */
+    const std::string &GetPreambleCachePath() const;
+
+    /**
+     * Get the files that the generated bindings depend on, which are the
+     * files that were loaded while parsing the sources, the configuration
+     * file and the files of its "!file" snippets.
+     */
+    std::set<std::string> GetDependencies() const;
+
+    /**
+     * Get the filenames of the generated files, relative to the output path,
+     * in the order that they were listed on stdout.
+     */
+    std::vector<std::string> GetOutputFiles() const;
+
 private:
     Configuration();
 
+    /**
+     * Reports the entries of the configuration that were not resolved by any
+     * translation unit, and exits if there are any.
+     */
+    void CheckUnresolved() const;
+
+    /**
+     * Reports the bindings that could not be written, and exits if there
+     * are any.
+     */
+    void CheckOutputErrors() const;
+
+    /**
+     * Assigns the bindings that are packed into shards to the shards once
+     * every translation unit has been processed, and determines which shards
+     * are out of date.
+     */
+    void AssignShards();
+
+    /**
+     * Whether an output file exists and has the same fingerprint as when it
+     * was generated by the previous run.
+     */
+    bool IsUpToDate(const std::string &path,
+                    const std::string &fingerprint) const;
+
+    /**
+     * Lists a generated file on stdout, and records it for the manifest.
+     */
+    void ListOutputFile(const std::string &filename) const;
+
 protected:
     YAML::Node configNode_;
     std::string bindingName_;
@@ -114,6 +279,102 @@ protected:
     std::string outputModuleName_;
     std::vector<std::string> inputNamespaceNames_;
     std::vector<std::string> inputSourcePaths_;
+    unsigned jobs_;
+    unsigned shards_;
+    bool minimalIncludes_;
+    bool incremental_;
+    std::string preambleCachePath_;
+
+    // Threads that can be started in addition to the ones that are running,
+    // so that parsing and rendering never use more than the configured number
+    // of jobs together.
+    mutable unsigned spareThreads_;
+    mutable std::mutex threadsMutex_;
+
+    // Contents of the files that are referenced by "!file" snippets, which
+    // are read once even if there are several translation units.
+    mutable std::map<std::string, std::string> snippets_;
+    mutable std::mutex snippetsMutex_;
+
+    // Files that were loaded while parsing the sources, which are added by
+    // each translation unit.
+    mutable std::set<std::string> dependencies_;
+    mutable std::mutex dependenciesMutex_;
+
+    // Filenames of the generated files, in the order in which they were
+    // listed.
+    mutable std::vector<std::string> outputFiles_;
+    mutable std::mutex outputFilesMutex_;
+
+    // Errors of the bindings that could not be written by the threads that
+    // render them, which are reported once every thread has finished.
+    mutable std::vector<std::string> outputErrors_;
+    mutable std::mutex outputErrorsMutex_;
+
+    // Number of translation units that resolved the configuration, and the
+    // number of them that could not resolve each entry, keyed by the error
+    // message of the entry.
+    mutable unsigned resolvingTranslationUnits_;
+    mutable std::map<std::string, unsigned> unresolvedEntries_;
+    mutable std::mutex unresolvedMutex_;
+
+    // Translation units that were traversed, the index of the first one
+    // that was not, and the mangled names of the bindings that were
+    // generated by any of them.
+    mutable std::vector<bool> traversed_;
+    mutable unsigned nextTraversal_;
+    mutable std::set<std::string> claimedBindings_;
+    mutable std::mutex traversalMutex_;
+    mutable std::condition_variable traversalCondition_;
+
+    /**
+     * The part of the top-level module that was generated by a translation
+     * unit, which no longer refers to its AST.
+     */
+    struct ModulePart
+    {
+        std::vector<std::string> binding_names;
+        ::mstch::array namespaces;
+        // Filenames of the bindings that are not packed into shards.
+        std::vector<std::string> filenames;
+    };
+
+    /**
+     * A binding that is packed into a shard.
+     */
+    struct ShardedBinding
+    {
+        std::string name;
+        unsigned cost;
+        std::string fingerprint;
+        std::string content;
+    };
+
+    // State of the top-level module, which is initialized by the first
+    // translation unit and completed by each of them.  The templates and
+    // snippets are the same for every translation unit.
+    mutable bool moduleInitialized_;
+    mutable ::mstch::compiled_template moduleTemplate_;
+    mutable ::mstch::compiled_template preludeTemplate_;
+    mutable ::mstch::map fileContext_;
+    mutable ::mstch::map mainContext_;
+    mutable std::vector<ModulePart> moduleParts_;
+    mutable std::mutex moduleMutex_;
+
+    // Bindings that are packed into shards in the order in which they were
+    // claimed, which are rendered as soon as their translation unit has been
+    // traversed, and the shard of each of them and whether each shard is out
+    // of date, which are known once every translation unit has been
+    // processed.
+    mutable std::vector<ShardedBinding> shardedBindings_;
+    std::vector<unsigned> shardAssignment_;
+    std::vector<bool> staleShards_;
+
+    // Fingerprints of the output files by filename, from the manifest of the
+    // previous run and for the manifest of this run.
+    mutable std::string fingerprintsPath_;
+    mutable std::map<std::string, std::string> previousFingerprints_;
+    mutable std::map<std::string, std::string> currentFingerprints_;
 
     friend class CompiledConfiguration;
 };
@@ -152,6 +413,16 @@ public:
      */
     const YAML::Node &GetDeclaration(const clang::Decl *decl) const;
 
+    /**
+     * Get the entries of the YAML configuration associated with a specific
+     * declaration as mstch values, or NULL if no configuration was found.
+     *
+     * The entries are converted once when the configuration is compiled, and
+     * are shared by all of the wrappers of the declaration.
+     */
+    std::shared_ptr<const ::mstch::object::constant_map> GetDeclarationContext(
+        const clang::Decl *decl) const;
+
     /**
      * Get the YAML configuration associated with a specific qualified type,
      * or return an empty YAML node if no configuration was found.
@@ -168,6 +439,19 @@ public:
      */
     clang::ASTContext &GetContext() const;
 
+    /**
+     * Gets the analysis of which declarations can be bound, which is shared
+     * by everything that is generated from this configuration.
+     */
+    EligibilityAnalysis &GetEligibility() const;
+
+    /**
+     * Gets the mutex that serializes access to the AST of this configuration
+     * from the template wrappers, which are rendered by several threads.
+     * The ASTs of other translation units are not affected.
+     */
+    std::recursive_mutex &GetASTMutex() const;
+
     /**
      * Gets the binding name of this configuration.
      *
@@ -178,11 +462,32 @@ public:
      */
     const std::string &GetBindingName() const;
 
+    /**
+     * Get a template value that is shared by all wrappers that refer to the
+     * same declaration, generating it the first time that it is requested.
+     *
+     * Values are identified by a name and a canonical declaration, and are
+     * kept for the lifetime of this configuration.
+     */
+    ::mstch::node GetSharedNode(
+        const std::string &name, const clang::Decl *decl,
+        const std::function<::mstch::node()> &generate) const;
+
     /**
      * Return if a declaration is enclosed by one of the configured namespaces.
      */
     bool IsEnclosed(const clang::Decl *decl) const;
 
+    /**
+     * Return if a declaration and everything declared within it can be
+     * skipped when traversing the AST, because none of them can be generated.
+     *
+     * This is the case for declarations outside of the files listed in the
+     * configuration, and for declaration contexts that neither enclose nor
+     * are enclosed by one of the configured namespaces.
+     */
+    bool IsPruned(const clang::Decl *decl) const;
+
     /**
      * Return if a declaration should not be generated.
      *
@@ -216,25 +521,148 @@ public:
     bool Render(const std::shared_ptr<chimera::mstch::Function> context);
     bool Render(const std::shared_ptr<chimera::mstch::Variable> context);
 
+    /**
+     * Render the bindings that were queued by Render() using the threads
+     * that are not used by other translation units, and record their
+     * filenames in the order in which they were queued.
+     *
+     * If the bindings are packed into shards, their content is kept for
+     * Configuration::RenderModule() instead, which writes the shards that
+     * changed.
+     *
+     * This must be called once the AST traversal is complete, since the
+     * clang-generated template entries are evaluated while rendering.
+     */
+    void RenderQueued();
+
 private:
     CompiledConfiguration(const Configuration &parent,
-                          clang::CompilerInstance *ci);
+                          clang::CompilerInstance *ci, unsigned index);
 
-    bool Render(std::string view, std::string key,
-                const std::shared_ptr<::mstch::object> &template_context);
+    bool Render(const ::mstch::compiled_template &view, const std::string &key,
+                const std::shared_ptr<::mstch::object> &template_context,
+                const clang::NamedDecl *decl);
+
+    bool IsInAllowedFile(const clang::Decl *decl) const;
+
+    /**
+     * Reports an entry of the configuration that could not be resolved in
+     * this translation unit.  With a single translation unit this is an
+     * error, otherwise it is only an error if no translation unit resolves
+     * the entry (see Configuration::CheckUnresolved()).
+     */
+    void ReportUnresolved(const std::string &message) const;
+
+    /**
+     * Whether the declarations in a declaration context are enclosed by the
+     * configured namespaces, and whether the context can be pruned (see
+     * IsEnclosed() and IsPruned()).
+     */
+    struct ContextVerdict
+    {
+        bool enclosed;
+        bool pruned;
+    };
+
+    /**
+     * Gets the verdict of a declaration context, which is computed once for
+     * each context since it is needed for almost every declaration.
+     */
+    ContextVerdict GetContextVerdict(const clang::DeclContext *context) const;
+
+    /**
+     * Gets the names of the files that must be included for the binding of a
+     * declaration (see chimera::util::getRequiredFiles()).
+     */
+    ::mstch::array GetRequiredHeaders(const clang::NamedDecl *decl);
+
+    /**
+     * Gets the fingerprint of a declaration, which changes when the source
+     * text of the declaration or of any declaration that its binding refers
+     * to, directly or indirectly, changes (see
+     * chimera::util::getReferencedDecls()).
+     */
+    uint64_t GetFingerprint(const clang::Decl *decl);
+
+    /**
+     * Gets the fingerprint of the source text of a declaration alone, and
+     * adds the canonical declarations that its binding refers to.
+     *
+     * Declarations in system headers are identified by their file instead,
+     * since these rarely change and refer to many other declarations.
+     */
+    uint64_t GetSourceFingerprint(const clang::Decl *decl,
+                                  std::vector<const clang::Decl *> &references);
 
 protected:
     static const YAML::Node emptyNode_;
     const Configuration &parent_;
+    const unsigned index_;
     const YAML::Node configNode_;
     const YAML::Node bindingNode_;
     std::string binding_name_;
     chimera::binding::Definition bindingDefinition_;
+    ::mstch::compiled_template classTemplate_;
+    ::mstch::compiled_template enumTemplate_;
+    ::mstch::compiled_template functionTemplate_;
+    ::mstch::compiled_template moduleTemplate_;
+    ::mstch::compiled_template preludeTemplate_;
+    ::mstch::compiled_template variableTemplate_;
     clang::CompilerInstance *ci_;
-    std::vector<std::pair<const clang::QualType, YAML::Node>> types_;
-    std::map<const clang::Decl *, YAML::Node> declarations_;
+    mutable EligibilityAnalysis eligibility_;
+    llvm::DenseMap<clang::QualType, YAML::Node> types_;
+    llvm::DenseMap<const clang::Decl *, YAML::Node> declarations_;
+    llvm::DenseMap<const clang::Decl *,
+                   std::shared_ptr<const ::mstch::object::constant_map>>
+        declarationContexts_;
+    ::mstch::map fileContext_;
+    ::mstch::map mainContext_;
+    llvm::DenseMap<const clang::FileEntry *, std::string> headerNames_;
     std::set<const clang::NamespaceDecl *> namespacesIncluded_;
     std::set<const clang::NamespaceDecl *> namespacesSuppressed_;
+    std::vector<std::string> files_;
+    mutable llvm::DenseMap<clang::FileID, bool> allowedFiles_;
+    mutable llvm::DenseMap<const clang::DeclContext *, ContextVerdict>
+        contextVerdicts_;
+    mutable std::mutex contextVerdictsMutex_;
+    mutable std::map<std::pair<std::string, const clang::Decl *>,
+                     ::mstch::node>
+        sharedNodes_;
+    mutable std::mutex sharedNodesMutex_;
+    mutable std::recursive_mutex astMutex_;
+
+    /**
+     * A binding that was queued by Render().
+     */
+    struct QueuedBinding
+    {
+        // Renders the binding and returns its content.  Unless the bindings
+        // are packed into shards, this also writes the binding's own file,
+        // and sets the error message if it could not be written.
+        std::function<std::string(std::string &error)> render;
+        std::string filename;
+        std::string path;
+        // Index of the binding among the bindings that are packed into
+        // shards (see Configuration::shardedBindings_).
+        std::size_t shard_index;
+        // Fingerprint of the binding's content, or an empty string if
+        // incremental generation is disabled.
+        std::string fingerprint;
+    };
+
+    std::vector<QueuedBinding> render_queue_;
+
+    // Filenames of the bindings that were rendered into their own files.
+    std::vector<std::string> filenames_;
+
+    // Fingerprints of everything that every binding depends on, such as the
+    // configuration and the templates, and of the traversed declarations.
+    std::string globalFingerprint_;
+    llvm::DenseMap<const clang::Decl *, uint64_t> fingerprints_;
+
+    // Fingerprints of the bindings that are not packed into shards by
+    // filename, for the manifest of this run.
+    std::map<std::string, std::string> currentFingerprints_;
 
     std::vector<std::string> binding_names_;
     std::vector<std::shared_ptr<chimera::mstch::Namespace>> binding_namespaces_;
@@ -10,14 +10,16 @@ namespace chimera
 class Consumer : public clang::ASTConsumer
 {
 public:
-    // Overrides the constructor in order to receive CompilerInstance.
-    Consumer(clang::CompilerInstance *ci);
+    // Overrides the constructor in order to receive CompilerInstance and the
+    // index of the translation unit among the sources.
+    Consumer(clang::CompilerInstance *ci, unsigned index);
 
     // Overrides method to call our ChimeraVisitor on the entire source file.
     void HandleTranslationUnit(clang::ASTContext &context) override;
 
 private:
     clang::CompilerInstance *ci_;
+    unsigned index_;
 };
 
 } // namespace chimera
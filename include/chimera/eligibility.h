@@ -0,0 +1,108 @@
+#ifndef __CHIMERA_ELIGIBILITY_H__
+#define __CHIMERA_ELIGIBILITY_H__
+
+#include <mutex>
+#include <string>
+#include <utility>
+#include <clang/AST/Decl.h>
+#include <clang/AST/DeclCXX.h>
+#include <clang/AST/Type.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <llvm/ADT/DenseMap.h>
+
+namespace chimera
+{
+
+/**
+ * Whether a declaration can be bound, and the reason if it cannot.
+ */
+struct Verdict
+{
+    enum class Reason
+    {
+        None,
+        NonPublicParameter,
+        RValueReference,
+        IncompleteType,
+        NonCopyableType,
+        NeedsReturnValuePolicy,
+    };
+
+    Reason reason = Reason::None;
+
+    // Explanation of the reason, such as "parameter 'x' has an incomplete
+    // type 'Foo'", or an empty string if the declaration can be bound.
+    std::string message;
+
+    bool eligible() const
+    {
+        return reason == Reason::None;
+    }
+};
+
+/**
+ * Memoized analysis of which declarations can be bound.
+ *
+ * The same declarations and parameter types are checked by several wrappers,
+ * and checking whether a type is complete may instantiate templates in Sema.
+ * This computes the verdict of each declaration once, and caches properties
+ * of types.  A warning is printed when a declaration is found to be
+ * ineligible, so each warning is printed at most once.
+ *
+ * The analysis uses the AST, so it must not be used concurrently with other
+ * accesses to the AST (see chimera::CompiledConfiguration::GetASTMutex()).
+ */
+class EligibilityAnalysis
+{
+public:
+    explicit EligibilityAnalysis(clang::CompilerInstance *ci);
+
+    /**
+     * Checks whether the parameters of a function can be bound.
+     *
+     * Functions are not eligible if a parameter has an incomplete type, or
+     * if a parameter that is passed by value is not copyable.  Methods are
+     * also not eligible if a parameter has a non-public type or is an rvalue
+     * reference, which is not reported as a warning for non-public types.
+     */
+    Verdict CheckParameters(const clang::FunctionDecl *decl);
+
+    /**
+     * Checks whether a return value policy can be deduced for a declaration
+     * that returns a value of the given type, which is not the case for
+     * reference and pointer types.
+     *
+     * Callers must only check this if the configuration does not specify a
+     * return value policy for the declaration.
+     */
+    Verdict CheckReturnType(const clang::NamedDecl *decl,
+                            clang::QualType return_type);
+
+    /**
+     * Returns whether a type is copyable (see chimera::util::isCopyable()).
+     */
+    bool IsCopyable(clang::QualType type);
+
+    /**
+     * Returns whether a type, or the type it points or refers to, is
+     * incomplete (see chimera::util::containsIncompleteType()).
+     */
+    bool ContainsIncompleteType(clang::QualType type);
+
+private:
+    Verdict ComputeParameters(const clang::FunctionDecl *decl);
+    Verdict ComputeReturnType(const clang::NamedDecl *decl,
+                              clang::QualType return_type);
+
+    clang::CompilerInstance *ci_;
+    std::mutex mutex_;
+    llvm::DenseMap<const clang::Decl *, Verdict> parameters_;
+    llvm::DenseMap<std::pair<const clang::Decl *, void *>, Verdict>
+        returnTypes_;
+    llvm::DenseMap<clang::QualType, bool> copyable_;
+    llvm::DenseMap<clang::QualType, bool> incomplete_;
+};
+
+} // namespace chimera
+
+#endif // __CHIMERA_ELIGIBILITY_H__
@@ -1,21 +1,68 @@
 #ifndef __CHIMERA_FRONTEND_ACTION_H__
 #define __CHIMERA_FRONTEND_ACTION_H__
 
+#include <atomic>
 #include <clang/AST/ASTConsumer.h>
 #include <clang/Frontend/CompilerInstance.h>
+#include <clang/Tooling/Tooling.h>
 #include "clang/Frontend/FrontendActions.h"
 
 namespace chimera
 {
 
+/**
+ * Process-wide counters of the preambles that were parsed from the preamble
+ * cache.
+ */
+struct PreambleCacheStats
+{
+    // Preambles that were parsed from an existing cache entry.
+    static std::atomic<unsigned long> reused;
+    // Preambles that were precompiled into a new cache entry.
+    static std::atomic<unsigned long> generated;
+};
+
 /**
  * Front-end that runs the Chimera AST consumer on the provided source.
  */
 class FrontendAction : public clang::ASTFrontendAction
 {
 public:
+    /**
+     * Creates a front-end for the translation unit of the source with the
+     * given index, which determines the order in which the translation units
+     * are traversed (see Configuration::BeginTraversal()).
+     */
+    explicit FrontendAction(unsigned index = 0);
+
+    /**
+     * Parses the preamble of the source from a precompiled header if a
+     * preamble cache is configured, which is generated on the first run and
+     * whenever one of the files that it loaded changes.
+     */
+    bool BeginInvocation(clang::CompilerInstance &CI) override;
+
     std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
         clang::CompilerInstance &CI, clang::StringRef file) override;
+
+private:
+    unsigned index_;
+};
+
+/**
+ * Creates the front-ends of the translation unit of a source, which is
+ * processed by its own clang::tooling::ClangTool so that the sources can be
+ * parsed in parallel.
+ */
+class FrontendActionFactory : public clang::tooling::FrontendActionFactory
+{
+public:
+    explicit FrontendActionFactory(unsigned index);
+
+    clang::FrontendAction *create() override;
+
+private:
+    unsigned index_;
 };
 
 } // namespace chimera
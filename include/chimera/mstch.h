@@ -12,6 +12,7 @@
 #include "chimera/configuration.h"
 #include "chimera/util.h"
 
+#include <mutex>
 #include <sstream>
 #include <clang/AST/AST.h>
 #include <clang/AST/Comment.h>
@@ -40,40 +41,19 @@ public:
       , last_(last)
     {
         // Add entries from the YAML configuration directly into the object.
-        // This wraps each YAML node in a recursive conversion wrapper.
-        for (YAML::const_iterator it = decl_config_.begin();
-             it != decl_config_.end(); ++it)
-        {
-            const std::string name = it->first.as<std::string>();
-            const YAML::Node &value = it->second;
-            register_lambda(
-                name, [value]() { return chimera::util::wrapYAMLNode(value); });
-        }
+        // These are converted once by the configuration and shared.
+        set_constants(config_.GetDeclarationContext(decl_));
 
         // Override certain entries with our clang-generated information.
-        register_methods(
-            this,
-            {
-                {"last", &ClangWrapper::last},
-                {"name", &ClangWrapper::name},
-                {"mangled_name", &ClangWrapper::mangledName},
-                {"qualified_name", &ClangWrapper::qualifiedName},
-                {"namespace_scope", &ClangWrapper::namespaceScope},
-                {"namespace_scope?",
-                 &ClangWrapper::isNonFalse<ClangWrapper,
-                                           &ClangWrapper::namespaceScope>},
-                {"class_scope", &ClangWrapper::classScope},
-                {"class_scope?",
-                 &ClangWrapper::isNonFalse<ClangWrapper,
-                                           &ClangWrapper::classScope>},
-                {"scope",
-                 &ClangWrapper::scope}, // namespace_scope + class_scope
-                {"scope?",
-                 &ClangWrapper::isNonFalse<ClangWrapper, &ClangWrapper::scope>},
-                {"comment", &ClangWrapper::comment},
-                {"comment?", &ClangWrapper::isNonFalse<ClangWrapper,
-                                                       &ClangWrapper::comment>},
-            });
+        // These are shared by all wrappers of the same type.
+        set_method_table(methodTable());
+
+        // Wrappers query the AST lazily while they are rendered, and many of
+        // these queries update caches in the ASTContext or instantiate
+        // templates in Sema, so every wrapper of the same AST holds its mutex
+        // while it computes a value.  This also caches every value, so
+        // `last` must be set before the wrapper is rendered.
+        synchronize(config_.GetASTMutex());
     }
 
     virtual ~ClangWrapper() = default;
@@ -184,17 +164,64 @@ public:
         last_ = is_last;
     }
 
+    const T *decl() const
+    {
+        return decl_;
+    }
+
 protected:
     const ::chimera::CompiledConfiguration &config_;
     const T *decl_;
     const YAML::Node &decl_config_;
     bool last_;
 
-    template <typename Derived, ::mstch::node (Derived::*Func)()>
-    ::mstch::node isNonFalse()
+    using MethodTable = ::mstch::object::method_table;
+
+    /**
+     * Creates a table entry that is true if the entry named by `key` would be
+     * rendered as a non-empty section.  The value of `key` is looked up on
+     * the object, so it is shared with the (memoized) entry itself.
+     */
+    static MethodTable::function predicate(const std::string &key)
     {
-        ::mstch::map context{{"data", (static_cast<Derived *>(this)->*Func)()}};
-        return ::mstch::render("{{^data}}NONE{{/data}}", context).empty();
+        const auto symbol = ::mstch::internal::intern(key);
+        return [symbol](::mstch::object &object) -> ::mstch::node {
+            return !::mstch::is_empty(object.at(symbol));
+        };
+    }
+
+    /**
+     * Returns the clang-generated template entries of this wrapper type.
+     *
+     * Subclasses extend this table with their own entries, and set it on
+     * each instance in their constructor.
+     */
+    static const MethodTable &methodTable()
+    {
+        static const MethodTable table = [] {
+            MethodTable table;
+            table.add("last", &ClangWrapper::last)
+                .add("name", &ClangWrapper::name)
+                .add("mangled_name", &ClangWrapper::mangledName)
+                .add("qualified_name", &ClangWrapper::qualifiedName)
+                .add("namespace_scope", &ClangWrapper::namespaceScope)
+                .add("namespace_scope?", predicate("namespace_scope"))
+                .add("class_scope", &ClangWrapper::classScope)
+                .add("class_scope?", predicate("class_scope"))
+                .add("scope", &ClangWrapper::scope) // namespace + class scope
+                .add("scope?", predicate("scope"))
+                .add("comment", &ClangWrapper::comment)
+                .add("comment?", predicate("comment"));
+
+            // Cache entries that only depend on the declaration, since
+            // templates typically reference them several times.
+            table.memoize({
+                "name", "mangled_name", "qualified_name", "namespace_scope",
+                "class_scope", "scope", "comment",
+            });
+            return table;
+        }();
+        return table;
     }
 };
 
@@ -224,6 +251,8 @@ public:
     ::mstch::node staticFields();
 
 protected:
+    static const MethodTable &methodTable();
+
     const std::set<const clang::CXXRecordDecl *> *available_decls_;
 };
 
@@ -239,6 +268,9 @@ public:
     ::mstch::node scope() override;
     ::mstch::node type();
     ::mstch::node values();
+
+protected:
+    static const MethodTable &methodTable();
 };
 
 class EnumConstant : public ClangWrapper<clang::EnumConstantDecl>
@@ -265,13 +297,15 @@ public:
     ::mstch::node returnValuePolicy();
     ::mstch::node qualifiedName() override;
 
+protected:
+    static const MethodTable &methodTable();
+
 private:
     const clang::CXXRecordDecl *class_decl_;
 };
 
 // TODO: refactor Function to not need class_decl at all.
-class Function : public ClangWrapper<clang::FunctionDecl>,
-                 public std::enable_shared_from_this<Function>
+class Function : public ClangWrapper<clang::FunctionDecl>
 {
 public:
     Function(const ::chimera::CompiledConfiguration &config,
@@ -294,6 +328,9 @@ public:
     ::mstch::node call();
     ::mstch::node qualifiedCall();
 
+protected:
+    static const MethodTable &methodTable();
+
 private:
     const clang::CXXRecordDecl *class_decl_;
     const int argument_limit_;
@@ -309,6 +346,9 @@ public:
     ::mstch::node isConst();
     ::mstch::node isStatic();
 
+protected:
+    static const MethodTable &methodTable();
+
 private:
     const clang::CXXMethodDecl *method_decl_;
 };
@@ -334,6 +374,9 @@ public:
     ::std::string nameAsString() override;
     ::mstch::node type();
 
+protected:
+    static const MethodTable &methodTable();
+
 private:
     const clang::FunctionDecl *method_decl_;
     const clang::CXXRecordDecl *class_decl_;
@@ -353,6 +396,9 @@ public:
     ::mstch::node classScope() override;
     ::mstch::node scope() override;
 
+protected:
+    static const MethodTable &methodTable();
+
 private:
     const clang::CXXRecordDecl *class_decl_;
 };
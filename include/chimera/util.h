@@ -1,9 +1,13 @@
 #ifndef __CHIMERA_UTIL_H__
 #define __CHIMERA_UTIL_H__
 
+#include <atomic>
 #include <set>
+#include <string>
+#include <vector>
 #include <clang/AST/ASTContext.h>
 #include <clang/AST/Type.h>
+#include <clang/Basic/SourceManager.h>
 #include <clang/Frontend/CompilerInstance.h>
 #include <mstch/mstch.hpp>
 #include <yaml-cpp/yaml.h>
@@ -20,6 +24,31 @@ namespace chimera
 namespace util
 {
 
+/**
+ * Process-wide counters of the cached names computed by the functions below.
+ *
+ * Mangled names, binding names and fully qualified type names are cached per
+ * ASTContext, and Eigen-stripped type strings are cached by string.
+ */
+struct NameCacheStats
+{
+    // Lookups that were answered from a cache.
+    static std::atomic<unsigned long> hits;
+    // Lookups that had to be computed.
+    static std::atomic<unsigned long> misses;
+};
+
+/**
+ * Process-wide counters of the files written by writeFileIfChanged().
+ */
+struct OutputStats
+{
+    // Files that were created or replaced.
+    static std::atomic<unsigned long> written;
+    // Files that already had the same content, and were left untouched.
+    static std::atomic<unsigned long> unchanged;
+};
+
 /**
  * Wrapper that generates context for a YAML node.
  *
@@ -117,6 +146,83 @@ const clang::ClassTemplateDecl *resolveClassTemplate(
 const clang::NamespaceDecl *resolveNamespace(clang::CompilerInstance *ci,
                                              const llvm::StringRef nsStr);
 
+/**
+ * Resolve a plain qualified name such as `::ns::Class` without parsing it.
+ *
+ * Each component of the name is looked up with Sema's qualified name lookup
+ * in the namespace or class named by the previous components.  Returns NULL
+ * if the string is not a plain qualified name, or if any component does not
+ * name a single declaration, in which case the string should be parsed.
+ */
+const clang::NamedDecl *lookupQualifiedName(clang::CompilerInstance *ci,
+                                            const llvm::StringRef name);
+
+/**
+ * Resolves many declaration, type, record, class template and namespace
+ * strings within the scope of a compiler instance at once.
+ *
+ * Type, record and namespace strings that are plain qualified names are
+ * resolved by lookupQualifiedName().  All other strings are parsed as they
+ * are by the resolve*() functions above, but in a single buffer when
+ * Resolve() is called instead of one buffer and parser per string.
+ *
+ * If the parser reports an error, the strings whose first declaration
+ * contains it are parsed again on their own, so that each error is attributed
+ * to the string that caused it.
+ *
+ * Each Add*() function returns an index to pass to the matching Get*()
+ * function once Resolve() was called.  The Get*() functions return the same
+ * values as the resolve*() functions, and print the same errors.
+ */
+class BatchResolver
+{
+public:
+    explicit BatchResolver(clang::CompilerInstance *ci);
+
+    std::size_t AddDeclaration(const std::string &declStr);
+    std::size_t AddType(const std::string &typeStr);
+    std::size_t AddRecord(const std::string &recordStr);
+    std::size_t AddClassTemplate(const std::string &recordStr);
+    std::size_t AddNamespace(const std::string &nsStr);
+
+    /**
+     * Resolves all of the strings that were added since the last call.
+     */
+    void Resolve();
+
+    const clang::NamedDecl *GetDeclaration(std::size_t index) const;
+    clang::QualType GetType(std::size_t index) const;
+    const clang::RecordDecl *GetRecord(std::size_t index) const;
+    const clang::ClassTemplateDecl *GetClassTemplate(std::size_t index) const;
+    const clang::NamespaceDecl *GetNamespace(std::size_t index) const;
+
+private:
+    enum class Kind
+    {
+        Declaration,
+        Type,
+        ClassTemplate,
+        Namespace,
+    };
+
+    struct Entry
+    {
+        // The declaration that is parsed if name lookup fails.
+        std::string declStr;
+        Kind kind;
+        // The resolved (canonical) declaration, or NULL.
+        const clang::NamedDecl *decl;
+        bool resolved;
+        // Whether the declaration was found by lookupQualifiedName().
+        bool looked_up;
+    };
+
+    std::size_t Add(const std::string &str, std::string declStr, Kind kind);
+
+    clang::CompilerInstance *ci_;
+    std::vector<Entry> entries_;
+};
+
 /**
  * Convert the type into one with fully qualified template parameters.
  *
@@ -144,13 +250,13 @@ std::string getFullyQualifiedDeclTypeAsString(const clang::TypeDecl *decl);
  * Get the base CXX record declarations for a CXXRecordDecl.
  *
  * This filters over all the base record entries for the given declaration
- * and returns the public entries. A set of 'available' decls can be
- * provided, in which case only base decls that exist in this set will be
- * returned.
+ * and returns the public entries in the order in which they are declared.
+ * A set of 'available' decls can be provided, in which case only base decls
+ * that exist in this set will be returned.
  */
-std::set<const clang::CXXRecordDecl *> getBaseClassDecls(
+std::vector<const clang::CXXRecordDecl *> getBaseClassDecls(
     const clang::CXXRecordDecl *decl);
-std::set<const clang::CXXRecordDecl *> getBaseClassDecls(
+std::vector<const clang::CXXRecordDecl *> getBaseClassDecls(
     const clang::CXXRecordDecl *decl,
     std::set<const clang::CXXRecordDecl *> available_decls);
 
@@ -166,7 +272,8 @@ std::string constructBindingName(const clang::CXXRecordDecl *decl);
 /**
  * Generate the C++ mangled name for a class.
  *
- * This name is generated from the Clang compiler name mangler.
+ * This name is generated from the Clang compiler name mangler, using a single
+ * mangle context per ASTContext.
  */
 std::string constructMangledName(const clang::NamedDecl *decl);
 
@@ -178,24 +285,6 @@ std::string constructMangledName(const clang::NamedDecl *decl);
  */
 bool containsIncompleteType(clang::Sema &sema, clang::QualType qual_type);
 
-/**
- * Returns whether any function parameters contain incomplete argument types.
- *
- * This is useful in cases where we need RTTI information about all arguments,
- * including references and pointers.
- */
-bool containsIncompleteType(clang::Sema &sema, const clang::FunctionDecl *decl);
-
-/**
- * Returns whether any function parameters contain RValue references.
- */
-bool containsRValueReference(const clang::FunctionDecl *decl);
-
-/**
- * Returns whether any function parameters contain a non-copyable type.
- */
-bool containsNonCopyableType(const clang::FunctionDecl *decl);
-
 /**
  * Determine if a CXXRecordDecl is referring to a type that could be assigned.
  */
@@ -253,16 +342,6 @@ std::string getTemplateParameterString(const clang::FunctionDecl *decl,
  */
 std::vector<std::string> getTemplateParameterStrings(const std::string &type);
 
-/**
- * Return whether a return value policy needs to be specfied for a declaration.
- *
- * In certain cases, it is possible to deduce the return value policy that
- * should be used for a given declaration and return type.  This function
- * checks and returns false if the return value policy can be deduced.
- */
-bool needsReturnValuePolicy(const clang::NamedDecl *decl,
-                            clang::QualType return_type);
-
 /**
  * Returns the minimum and maximum number of arguments that a function can take.
  *
@@ -272,12 +351,37 @@ std::pair<unsigned, unsigned> getFunctionArgumentRange(
     const clang::FunctionDecl *decl);
 
 /**
- * Returns whether a method has a non-public type of parameter.
+ * Estimates the relative cost of compiling the binding of a declaration.
  *
- * This is possible when the class wants to hide the constructor from being
- * called publicly.
+ * This is the number of functions that the binding defines, counting each
+ * overloaded method separately, multiplied by one more than the deepest
+ * nesting of template arguments in their types, since nested templates are
+ * expensive to instantiate.  A function is bound on its own, without its
+ * overloads.
  */
-bool hasNonPublicParam(const clang::CXXMethodDecl *decl);
+unsigned estimateCompileCost(const clang::NamedDecl *decl);
+
+/**
+ * Gets the declarations that the binding of a declaration refers to.
+ *
+ * These are the declarations of its bases and of the types of its public
+ * fields, parameters and return values, or of the type of a variable or
+ * typedef, including the typedefs that these types are spelled with and the
+ * arguments of template specializations.  The declarations are returned in
+ * the order that they are first referred to, and may contain duplicates.
+ */
+std::vector<const clang::Decl *> getReferencedDecls(const clang::Decl *decl);
+
+/**
+ * Gets the files that must be included for the binding of a declaration.
+ *
+ * These are the files that declare the declaration itself and the
+ * declarations that its binding refers to (see getReferencedDecls()), in the
+ * order that they are first referred to.  System headers are replaced by the
+ * outermost system header that includes them.
+ */
+std::vector<const clang::FileEntry *> getRequiredFiles(
+    const clang::SourceManager &sm, const clang::NamedDecl *decl);
 
 /**
  * Trims from end of string (right)
@@ -299,6 +403,51 @@ std::string trim(std::string s, const char *t = " \t\n\r\f\v");
  */
 bool startsWith(const std::string &str, const std::string &prefix);
 
+/**
+ * Returns the MD5 hash of a content as a hexadecimal string.
+ */
+std::string hashContent(llvm::StringRef content);
+
+/**
+ * Writes a generated file unless it already has the same content.
+ *
+ * The MD5 hash of the content is compared with the hash of the existing
+ * file, so that the modification time of a file only changes if its content
+ * changes.  Files are replaced atomically by writing a temporary file in the
+ * same directory and renaming it.
+ *
+ * Returns false if the file could not be written.
+ */
+bool writeFileIfChanged(const std::string &path, const std::string &content);
+
+/**
+ * Writes a JSON manifest of the generated files of a module, whose
+ * filenames are relative to the output path, e.g.
+ *
+ *   {
+ *     "module": "example",
+ *     "output_path": "bindings",
+ *     "files": [
+ *       "example_prelude.h",
+ *       "example.cpp"
+ *     ]
+ *   }
+ *
+ * Returns false if the file could not be written.
+ */
+bool writeManifest(const std::string &path, const std::string &module_name,
+                   const std::string &output_path,
+                   const std::vector<std::string> &files);
+
+/**
+ * Writes a Makefile-style depfile, like the ones that are written by GCC and
+ * Clang with `-MD`, which lists the files that a target depends on.
+ *
+ * Returns false if the file could not be written.
+ */
+bool writeDepfile(const std::string &path, const std::string &target,
+                  const std::set<std::string> &dependencies);
+
 /**
  * Returns the concrete type in string from a type.
  *
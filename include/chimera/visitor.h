@@ -3,6 +3,7 @@
 
 #include "chimera/configuration.h"
 
+#include <atomic>
 #include <set>
 #include <clang/AST/ASTContext.h>
 #include <clang/AST/RecursiveASTVisitor.h>
@@ -11,6 +12,17 @@
 namespace chimera
 {
 
+/**
+ * Process-wide counters of the declarations seen by the AST traversal.
+ */
+struct TraversalStats
+{
+    // Declarations that were visited.
+    static std::atomic<unsigned long> visited_decls;
+    // Declarations that were skipped along with everything declared in them.
+    static std::atomic<unsigned long> skipped_decls;
+};
+
 class Visitor : public clang::RecursiveASTVisitor<Visitor>
 {
 public:
@@ -19,8 +31,21 @@ public:
 
     bool shouldVisitImplicitCode() const;
     bool shouldVisitTemplateInstantiations() const;
+
+    /**
+     * Traverses a declaration unless the configuration prunes it, in which
+     * case none of its children are traversed either.
+     */
+    bool TraverseDecl(clang::Decl *decl);
     bool VisitDecl(clang::Decl *decl);
 
+    /**
+     * Renders the bindings that were generated while traversing the AST.
+     * This must be called after the traversal, before the visitor is
+     * destroyed.
+     */
+    void RenderBindings();
+
 protected:
     bool GenerateCXXRecord(clang::CXXRecordDecl *decl);
     bool GenerateEnum(clang::EnumDecl *decl);
@@ -4,14 +4,24 @@
 #include "chimera/chimera.h"
 #include "chimera/configuration.h"
 #include "chimera/frontend_action.h"
+#include "chimera/util.h"
+#include "chimera/visitor.h"
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
 #include <clang/Tooling/ArgumentsAdjusters.h>
 #include <clang/Tooling/CommonOptionsParser.h>
 #include <clang/Tooling/Tooling.h>
 #include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <mstch/mstch.hpp>
 
 #define STR_DETAIL(x) #x
 #define STR(x) STR_DETAIL(x)
@@ -71,6 +81,71 @@ static cl::opt<bool> SuppressSources(
     "no-default-sources", cl::cat(ChimeraCategory),
     cl::desc("Suppress the forwarding of source file paths to binding"));
 
+// Option for specifying the number of threads used to parse the sources and
+// render bindings.
+static cl::opt<unsigned> Jobs(
+    "jobs", cl::cat(ChimeraCategory),
+    cl::desc("Specify the number of threads used to parse the sources and "
+             "render bindings"),
+    cl::value_desc("N"), cl::init(1));
+
+// Option for packing the bindings into a fixed number of files.
+static cl::opt<unsigned> Shards(
+    "shards", cl::cat(ChimeraCategory),
+    cl::desc("Pack the bindings into N shard files instead of one file per "
+             "binding"),
+    cl::value_desc("N"), cl::init(0));
+
+// Option for only including the files that each binding requires.
+static cl::opt<bool> MinimalIncludes(
+    "minimal-includes", cl::cat(ChimeraCategory),
+    cl::desc("Include only the headers that each binding requires instead of "
+             "every source file"));
+
+// Option for skipping bindings that did not change since the last run.
+static cl::opt<bool> Incremental(
+    "incremental", cl::cat(ChimeraCategory),
+    cl::desc("Skip rendering bindings whose fingerprint did not change since "
+             "the last run (with -shards, skip writing the shards instead)"));
+
+// Option for caching the precompiled preambles of the sources between runs.
+static cl::opt<std::string> PreambleCachePath(
+    "preamble-cache", cl::cat(ChimeraCategory),
+    cl::desc("Cache the precompiled preambles of the sources in a directory"),
+    cl::value_desc("directory"));
+
+// Option for parsing the sources with a prebuilt precompiled header.
+static cl::opt<std::string> PrecompiledHeader(
+    "pch", cl::cat(ChimeraCategory),
+    cl::desc("Include a precompiled header or AST file that was built with "
+             "the same compiler arguments"),
+    cl::value_desc("filename"));
+
+// Option for writing a manifest of the generated files.
+static cl::opt<std::string> Manifest(
+    "manifest", cl::cat(ChimeraCategory),
+    cl::desc("Write a JSON manifest that lists the generated files"),
+    cl::value_desc("filename"));
+
+// Option for writing a depfile that lists the files the bindings depend on.
+static cl::opt<std::string> Depfile(
+    "depfile", cl::cat(ChimeraCategory),
+    cl::desc("Write a Makefile-style depfile that lists every file that the "
+             "bindings depend on"),
+    cl::value_desc("filename"));
+
+// Option for specifying the target of the rule in the depfile.
+static cl::opt<std::string> DepfileTarget(
+    "depfile-target", cl::cat(ChimeraCategory),
+    cl::desc("Specify the target of the depfile rule (defaults to the "
+             "top-level binding file)"),
+    cl::value_desc("target"));
+
+// Option for printing statistics about the generation to stderr.
+static cl::opt<bool> PrintStats(
+    "stats", cl::cat(ChimeraCategory),
+    cl::desc("Print binding generation statistics to stderr"));
+
 // Add a footer to the help text.
 static cl::extrahelp MoreHelp(
     "\n"
@@ -112,6 +187,22 @@ int run(int argc, const char **argv)
         chimera::Configuration::GetInstance().SetOutputModuleName(
             OutputModuleName);
 
+    // Set the number of threads used to parse the sources and render bindings.
+    chimera::Configuration::GetInstance().SetJobs(Jobs);
+
+    // Set the number of shard files that the bindings are packed into.
+    chimera::Configuration::GetInstance().SetShards(Shards);
+
+    // Set whether each binding only includes the files that it requires.
+    chimera::Configuration::GetInstance().SetMinimalIncludes(MinimalIncludes);
+
+    // Set whether bindings that did not change since the last run are skipped.
+    chimera::Configuration::GetInstance().SetIncremental(Incremental);
+
+    // Set the directory in which precompiled preambles are cached.
+    chimera::Configuration::GetInstance().SetPreambleCachePath(
+        PreambleCachePath);
+
     // Add top-level namespaces to the configuration.
     if (NamespaceNames.size())
         for (const std::string &name : NamespaceNames)
@@ -123,28 +214,169 @@ int run(int argc, const char **argv)
         for (const std::string &path : OptionsParser.getSourcePathList())
             chimera::Configuration::GetInstance().AddSourcePath(path);
 
-    // Create tool that uses the command-line options.
-    ClangTool Tool(OptionsParser.getCompilations(),
-                   OptionsParser.getSourcePathList());
+    // Adds the arguments that chimera requires to the compile commands of a
+    // tool.
+    const auto addArgumentsAdjusters = [](ClangTool &tool) {
+        // Add or suppress clang documentation flag as specified.
+        tool.appendArgumentsAdjuster(getInsertArgumentAdjuster(
+            SuppressDocs ? "-Wno-documentation" : "-Wdocumentation",
+            ArgumentInsertPosition::BEGIN));
 
-    // Add or suppress clang documentation flag as specified.
-    Tool.appendArgumentsAdjuster(getInsertArgumentAdjuster(
-        SuppressDocs ? "-Wno-documentation" : "-Wdocumentation",
-        ArgumentInsertPosition::BEGIN));
+        // Add the appropriate C/C++ language flag.
+        tool.appendArgumentsAdjuster(getInsertArgumentAdjuster(
+            UseCMode ? "-xc" : "-xc++", ArgumentInsertPosition::BEGIN));
 
-    // Add the appropriate C/C++ language flag.
-    Tool.appendArgumentsAdjuster(getInsertArgumentAdjuster(
-        UseCMode ? "-xc" : "-xc++", ArgumentInsertPosition::BEGIN));
+        // Add a workaround for the bug in clang shipped default with Ubuntu
+        // 14.04.
+        // https://bugs.launchpad.net/ubuntu/+source/llvm-defaults/+bug/1242300
+        tool.appendArgumentsAdjuster(getInsertArgumentAdjuster(
+            "-I/usr/lib/llvm-" STR(LLVM_VERSION_MAJOR) "." STR(
+                LLVM_VERSION_MINOR) "/lib/clang/" LLVM_VERSION_STRING
+                "/include",
+            ArgumentInsertPosition::END));
+
+        // Include a prebuilt precompiled header, which replaces the preamble
+        // cache.
+        if (!PrecompiledHeader.empty())
+            tool.appendArgumentsAdjuster(getInsertArgumentAdjuster(
+                CommandLineArguments{"-include-pch", PrecompiledHeader},
+                ArgumentInsertPosition::END));
+    };
+
+    // Each source is parsed by its own tool.  The sources are made absolute,
+    // since a tool changes the working directory of the process to the
+    // directory of each of its compile commands.
+    std::vector<std::string> sources;
+    std::set<std::string> directories;
+    for (const std::string &path : OptionsParser.getSourcePathList())
+    {
+        SmallString<256> source(path);
+        sys::fs::make_absolute(source);
+        sources.emplace_back(source.begin(), source.end());
+
+        for (const CompileCommand &command :
+             OptionsParser.getCompilations().getCompileCommands(sources.back()))
+            directories.insert(command.Directory);
+    }
 
-    // Add a workaround for the bug in clang shipped default with Ubuntu 14.04.
-    // https://bugs.launchpad.net/ubuntu/+source/llvm-defaults/+bug/1242300
-    Tool.appendArgumentsAdjuster(getInsertArgumentAdjuster(
-        "-I/usr/lib/llvm-" STR(LLVM_VERSION_MAJOR) "." STR(
-            LLVM_VERSION_MINOR) "/lib/clang/" LLVM_VERSION_STRING "/include",
-        ArgumentInsertPosition::END));
+    // The sources can only be parsed in parallel if they are all compiled in
+    // the same directory, which is the case for the compile commands that
+    // follow "--", so that the tools do not change the working directory
+    // while another one is parsing.  This directory is also used to render
+    // the top-level module, and the working directory is restored after.
+    SmallString<256> initial_directory;
+    sys::fs::current_path(initial_directory);
+    bool parallel = (directories.size() <= 1);
+    if (parallel && !directories.empty()
+        && ::chdir(directories.begin()->c_str()) != 0)
+        parallel = false;
+
+    // At most one source is parsed per job.  The threads of the workers are
+    // taken from the jobs that are also used to render the bindings, and
+    // each worker returns its thread once there are no sources left, so that
+    // the remaining sources render their bindings with it.
+    chimera::Configuration &config = chimera::Configuration::GetInstance();
+    const unsigned num_sources = static_cast<unsigned>(sources.size());
+    const unsigned workers
+        = parallel ? std::max(1u, std::min(config.GetJobs(), num_sources)) : 1;
+    config.SetTranslationUnits(num_sources);
+    const unsigned extra_workers = config.ReserveThreads(workers - 1);
+
+    // Each worker repeatedly takes the next source, so that the sources are
+    // parsed in their order.  A source is marked as traversed once its tool
+    // returns, even if it failed to parse, so that the next ones proceed.
+    std::vector<int> results(num_sources, 0);
+    std::atomic<unsigned> next(0);
+    const auto run_tools = [&]() {
+        for (unsigned i = next++; i < num_sources; i = next++)
+        {
+            ClangTool tool(OptionsParser.getCompilations(),
+                           ArrayRef<std::string>(sources[i]));
+            addArgumentsAdjusters(tool);
+
+            // Run the instantiated tool on the Chimera frontend.
+            chimera::FrontendActionFactory factory(i);
+            results[i] = tool.run(&factory);
+            config.EndTraversal(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < extra_workers; ++i)
+    {
+        threads.emplace_back([&]() {
+            run_tools();
+            config.ReleaseThreads(1);
+        });
+    }
+    run_tools();
+    for (auto &thread : threads)
+        thread.join();
+    int result = 0;
+    for (const int tool_result : results)
+        result = std::max(result, tool_result);
+
+    // Render the top-level module from the bindings of every source.
+    config.RenderModule();
+    if (::chdir(initial_directory.c_str()) != 0)
+        std::cerr << "Warning: Failed to restore the working directory "
+                  << "'" << initial_directory.str().str() << "'." << std::endl;
+
+    // Write the list of generated files for tools and build systems.
+    if (!Manifest.empty())
+    {
+        if (!chimera::util::writeManifest(Manifest,
+                                          config.GetOutputModuleName(),
+                                          config.GetOutputPath(),
+                                          config.GetOutputFiles()))
+        {
+            std::cerr << "Failed to write manifest "
+                      << "'" << Manifest << "'." << std::endl;
+            exit(-4);
+        }
+    }
+
+    // Write the files that were read to generate the bindings, so that the
+    // build system knows when to regenerate them.
+    if (!Depfile.empty())
+    {
+        const std::string target
+            = DepfileTarget.empty() ? config.GetOutputPath() + "/"
+                                          + config.GetOutputModuleName()
+                                          + ".cpp"
+                                    : DepfileTarget;
+        if (!chimera::util::writeDepfile(Depfile, target,
+                                         config.GetDependencies()))
+        {
+            std::cerr << "Failed to write depfile "
+                      << "'" << Depfile << "'." << std::endl;
+            exit(-4);
+        }
+    }
+
+    // Report statistics on stderr, since stdout lists the generated files.
+    std::cerr << "Generated files: " << chimera::util::OutputStats::written
+              << " written, " << chimera::util::OutputStats::unchanged
+              << " unchanged." << std::endl;
+    if (PrintStats)
+    {
+        std::cerr << "Traversed declarations: "
+                  << chimera::TraversalStats::visited_decls << " visited, "
+                  << chimera::TraversalStats::skipped_decls
+                  << " skipped with their contents." << std::endl;
+        std::cerr << "Memoized template values: "
+                  << ::mstch::memoization_stats::hits << " reused, "
+                  << ::mstch::memoization_stats::misses << " computed."
+                  << std::endl;
+        std::cerr << "Cached names: " << chimera::util::NameCacheStats::hits
+                  << " reused, " << chimera::util::NameCacheStats::misses
+                  << " computed." << std::endl;
+        std::cerr << "Cached preambles: " << chimera::PreambleCacheStats::reused
+                  << " reused, " << chimera::PreambleCacheStats::generated
+                  << " generated." << std::endl;
+    }
 
-    // Run the instantiated tool on the Chimera frontend.
-    return Tool.run(newFrontendActionFactory<chimera::FrontendAction>().get());
+    return result;
 }
 
 } // namespace chimera
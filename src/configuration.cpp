@@ -2,11 +2,22 @@
 #include "chimera/mstch.h"
 #include "chimera/util.h"
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <clang/Lex/HeaderSearch.h>
+#include <clang/Lex/HeaderSearchOptions.h>
+#include <clang/Lex/Lexer.h>
+#include <clang/Lex/Preprocessor.h>
+#include <clang/Lex/PreprocessorOptions.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
 
 using namespace clang;
 
@@ -14,19 +25,61 @@ namespace
 {
 
 /**
- * Map of counts of each long prefix encountered.
- *
- * This allows the generation of safe incrementing filenames in the case
- * that many long paths with the same prefix are encountered.
+ * Prepares a binding template for rendering, preferring its ahead-of-time
+ * compiled render function if one is available.
+ */
+::mstch::compiled_template compileTemplate(
+    const std::string &source, ::mstch::aot::render_function function)
+{
+    if (function)
+        return ::mstch::compiled_template(function);
+
+    return ::mstch::compiled_template(source);
+}
+
+/**
+ * Hashes a string with 64-bit FNV-1a, which gives the same value on every
+ * platform and run, unlike std::hash.  The result is mixed with the MurmurHash3
+ * finalizer, since positions on a hash ring depend on the high bits, which
+ * FNV-1a mixes poorly for short strings.
  */
-std::map<std::string, int> large_filename_prefixes;
+uint64_t stableHash(const std::string &str)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const char c : str)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * Formats a hash as 16 hexadecimal digits.
+ */
+std::string toHex(uint64_t hash)
+{
+    std::stringstream ss;
+    ss << std::hex << std::setfill('0') << std::setw(16) << hash;
+    return ss.str();
+}
 
 constexpr int MAX_PATH_LENGTH = 255;
-constexpr int MAX_COUNTER_LENGTH = 4;
+constexpr int HASH_LENGTH = 16;
 
 /**
  * De-conflicts paths that are longer than 255 characters.
  * (This is the maximum path length on many operating systems.)
+ *
+ * Long paths are truncated and suffixed with a hash of their filename, so
+ * that a binding is always written to the same file, regardless of the order
+ * in which the bindings are visited and of the output directory.
  */
 std::string sanitizePath(const std::string &path)
 {
@@ -34,34 +87,240 @@ std::string sanitizePath(const std::string &path)
     if (path.size() < MAX_PATH_LENGTH)
         return path;
 
-    // If the path length is long, compute a safe prefix and append an
-    // incrementing counter variable to the end of the filename.
+    // If the path length is long, compute a safe prefix and append a hash of
+    // the filename to the end of the filename.
     size_t suffix_index = path.find_last_of(".");
     const std::string path_suffix
         = (suffix_index == std::string::npos) ? "" : path.substr(suffix_index);
     const int prefix_size = std::max(
-        0, MAX_PATH_LENGTH - MAX_COUNTER_LENGTH - (int)path_suffix.size() - 2);
+        0, MAX_PATH_LENGTH - HASH_LENGTH - (int)path_suffix.size() - 2);
     const std::string path_prefix = path.substr(0, prefix_size);
-    const int index = large_filename_prefixes[path_prefix]++;
+    const std::string filename = path.substr(path.find_last_of("/") + 1);
 
-    // Create the new filename as "prefix_{index}.suffix"
+    // Create the new filename as "prefix_{hash}.suffix"
     std::stringstream ss;
     ss << path_prefix << "_";
-    ss << std::setfill('0') << std::setw(MAX_COUNTER_LENGTH) << index;
+    ss << std::hex << std::setfill('0') << std::setw(HASH_LENGTH)
+       << stableHash(filename);
     if (path_suffix.length())
         ss << path_suffix;
     return ss.str();
 }
 
+/**
+ * Resolves a path from the configuration file relative to the directory of
+ * the configuration file itself.
+ */
+std::string resolveConfigPath(const std::string &config_path,
+                              const std::string &path)
+{
+    // TODO: this is somewhat brittle.
+    if (path.front() == '/')
+        return path;
+
+    std::size_t found = config_path.rfind("/");
+    if (found != std::string::npos)
+        return config_path.substr(0, found) + "/" + path;
+
+    return "./" + path;
+}
+
+/**
+ * Converts a path into an absolute path without "." or ".." components, so
+ * that paths that are spelled differently can be compared.
+ */
+std::string normalizePath(const std::string &path)
+{
+    llvm::SmallString<256> absolute_path(path);
+    llvm::sys::fs::make_absolute(absolute_path);
+
+    std::vector<llvm::StringRef> components;
+    for (auto it = llvm::sys::path::begin(absolute_path),
+              end = llvm::sys::path::end(absolute_path);
+         it != end; ++it)
+    {
+        if (*it == ".")
+            continue;
+
+        if (*it == "..")
+        {
+            // Never remove the root component.
+            if (components.size() > 1)
+                components.pop_back();
+            continue;
+        }
+
+        components.push_back(*it);
+    }
+
+    llvm::SmallString<256> normalized_path;
+    for (const auto &component : components)
+        llvm::sys::path::append(normalized_path, component);
+    return std::string(normalized_path.begin(), normalized_path.end());
+}
+
+/**
+ * Returns whether a key in the 'classes' section of the configuration refers
+ * to a class template rather than to a class.
+ */
+bool isClassTemplateString(const std::string &decl_str)
+{
+    return chimera::util::startsWith(decl_str, "template ")
+           || chimera::util::startsWith(decl_str, "template<");
+}
+
+/**
+ * Assigns each binding to one of `num_shards` shards, and returns the shard
+ * of each binding.
+ *
+ * This uses consistent hashing with bounded loads: each shard owns several
+ * points on a hash ring, and each binding is assigned to the first shard
+ * after the hash of its name whose estimated cost stays within 25% of the
+ * average.  Bindings are placed in the order of their hashes, so that the
+ * assignment does not depend on the traversal order, and most bindings stay
+ * in the same shard when other bindings are added, removed or changed.
+ */
+std::vector<unsigned> assignShards(const std::vector<std::string> &names,
+                                   const std::vector<unsigned> &costs,
+                                   unsigned num_shards)
+{
+    constexpr unsigned POINTS_PER_SHARD = 64;
+    std::vector<std::pair<uint64_t, unsigned>> ring;
+    for (unsigned shard = 0; shard < num_shards; ++shard)
+    {
+        for (unsigned point = 0; point < POINTS_PER_SHARD; ++point)
+        {
+            ring.emplace_back(stableHash(std::to_string(shard) + "/"
+                                         + std::to_string(point)),
+                              shard);
+        }
+    }
+    std::sort(ring.begin(), ring.end());
+
+    uint64_t total_cost = 0;
+    std::vector<std::pair<uint64_t, std::size_t>> order;
+    for (std::size_t i = 0; i < names.size(); ++i)
+    {
+        total_cost += costs[i];
+        order.emplace_back(stableHash(names[i]), i);
+    }
+    std::sort(order.begin(), order.end(),
+              [&names](const std::pair<uint64_t, std::size_t> &a,
+                       const std::pair<uint64_t, std::size_t> &b) {
+                  return a.first != b.first ? a.first < b.first
+                                            : names[a.second] < names[b.second];
+              });
+
+    const uint64_t capacity
+        = (total_cost * 5 / 4 + num_shards - 1) / num_shards;
+    std::vector<uint64_t> loads(num_shards, 0);
+    std::vector<unsigned> shards(names.size(), 0);
+    for (const auto &it : order)
+    {
+        const std::size_t i = it.second;
+        const std::size_t start
+            = std::lower_bound(ring.begin(), ring.end(),
+                               std::make_pair(it.first, 0u))
+              - ring.begin();
+
+        // Use the least loaded shard if the binding does not fit anywhere,
+        // which only happens if it costs more than a shard can hold.
+        unsigned shard = static_cast<unsigned>(
+            std::min_element(loads.begin(), loads.end()) - loads.begin());
+        for (std::size_t k = 0; k < ring.size(); ++k)
+        {
+            const unsigned candidate = ring[(start + k) % ring.size()].second;
+            if (loads[candidate] + costs[i] <= capacity)
+            {
+                shard = candidate;
+                break;
+            }
+        }
+
+        loads[shard] += costs[i];
+        shards[i] = shard;
+    }
+    return shards;
+}
+
+/**
+ * Returns the path of the file that a shard of the bindings is written to.
+ */
+std::string getShardPath(const chimera::Configuration &config, unsigned shard)
+{
+    return sanitizePath(config.GetOutputPath() + "/"
+                        + config.GetOutputModuleName() + "_shard_"
+                        + std::to_string(shard) + ".cpp");
+}
+
+/**
+ * Returns a copy of a template value that can be rendered after the AST that
+ * it was generated from has been destroyed.
+ *
+ * Objects are replaced by maps of the values of every entry that they answer,
+ * including the entries of their YAML configuration, which are copied in the
+ * same way.  The value must not refer back to itself, which is the case for
+ * namespaces, whose scopes only contain their enclosing namespaces.
+ */
+::mstch::node snapshotNode(const ::mstch::node &node)
+{
+    if (const auto *object
+        = boost::get<std::shared_ptr<::mstch::object>>(&node))
+    {
+        ::mstch::map snapshot;
+        for (const auto key : (*object)->keys())
+            snapshot.emplace(::mstch::internal::name_of(key),
+                             snapshotNode((*object)->at(key)));
+        return snapshot;
+    }
+
+    if (const auto *array = boost::get<::mstch::array>(&node))
+    {
+        ::mstch::array snapshot;
+        for (const auto &element : *array)
+            snapshot.push_back(snapshotNode(element));
+        return snapshot;
+    }
+
+    if (const auto *map = boost::get<::mstch::map>(&node))
+    {
+        ::mstch::map snapshot;
+        for (const auto &it : *map)
+            snapshot.emplace(it.first, snapshotNode(it.second));
+        return snapshot;
+    }
+
+    return node;
+}
+
 } // namespace
 
 const YAML::Node chimera::CompiledConfiguration::emptyNode_(
     YAML::NodeType::Undefined);
 
 chimera::Configuration::Configuration()
-  : outputPath_("."), outputModuleName_("chimera_binding")
+  : outputPath_(".")
+  , outputModuleName_("chimera_binding")
+  , jobs_(1)
+  , shards_(0)
+  , minimalIncludes_(false)
+  , incremental_(false)
+  , spareThreads_(0)
+  , resolvingTranslationUnits_(0)
+  , traversed_(1, false)
+  , nextTraversal_(0)
+  , moduleInitialized_(false)
+  , moduleParts_(1)
 {
-    // Do nothing.
+    // Set custom escape function that disables HTML escaping on mstch output.
+    //
+    // This is not desirable in chimera because many C++ types include
+    // characters that can be accidentally escaped, such as `<>` and `&`.
+    //
+    // See: https://github.com/no1msd/mstch#custom-escape-function
+    //
+    ::mstch::config::escape
+        = [](const std::string &str) -> std::string { return str; };
 }
 
 chimera::Configuration &chimera::Configuration::GetInstance()
@@ -137,11 +396,95 @@ void chimera::Configuration::AddSourcePath(const std::string &sourcePath)
     inputSourcePaths_.push_back(sourcePath);
 }
 
+void chimera::Configuration::SetJobs(unsigned jobs)
+{
+    // Rendering requires at least one thread, so we simply fail here to try
+    // to alert the user as soon as possible to a possible parsing issue.
+    if (jobs == 0)
+    {
+        std::cerr << "Number of jobs must be at least 1." << std::endl;
+        exit(-1);
+    }
+    jobs_ = jobs;
+    spareThreads_ = jobs - 1;
+}
+
+void chimera::Configuration::SetShards(unsigned shards)
+{
+    shards_ = shards;
+}
+
+void chimera::Configuration::SetMinimalIncludes(bool minimal)
+{
+    minimalIncludes_ = minimal;
+}
+
+void chimera::Configuration::SetIncremental(bool incremental)
+{
+    incremental_ = incremental;
+}
+
+void chimera::Configuration::SetPreambleCachePath(const std::string &path)
+{
+    preambleCachePath_ = path;
+}
+
+void chimera::Configuration::AddDependency(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(dependenciesMutex_);
+    dependencies_.insert(normalizePath(path));
+}
+
+void chimera::Configuration::SetTranslationUnits(unsigned count)
+{
+    traversed_.assign(count, false);
+    moduleParts_.assign(count, ModulePart());
+}
+
+unsigned chimera::Configuration::ReserveThreads(unsigned count) const
+{
+    std::lock_guard<std::mutex> lock(threadsMutex_);
+    const unsigned reserved = std::min(count, spareThreads_);
+    spareThreads_ -= reserved;
+    return reserved;
+}
+
+void chimera::Configuration::ReleaseThreads(unsigned count) const
+{
+    std::lock_guard<std::mutex> lock(threadsMutex_);
+    spareThreads_ += count;
+}
+
+bool chimera::Configuration::BeginTraversal(unsigned index)
+{
+    std::unique_lock<std::mutex> lock(traversalMutex_);
+    if (index >= traversed_.size())
+        traversed_.resize(index + 1, false);
+    if (traversed_[index])
+        return false;
+
+    traversalCondition_.wait(
+        lock, [this, index]() { return nextTraversal_ >= index; });
+    return !traversed_[index];
+}
+
+void chimera::Configuration::EndTraversal(unsigned index)
+{
+    std::lock_guard<std::mutex> lock(traversalMutex_);
+    if (index >= traversed_.size())
+        traversed_.resize(index + 1, false);
+    traversed_[index] = true;
+
+    while (nextTraversal_ < traversed_.size() && traversed_[nextTraversal_])
+        ++nextTraversal_;
+    traversalCondition_.notify_all();
+}
+
 std::unique_ptr<chimera::CompiledConfiguration> chimera::Configuration::Process(
-    CompilerInstance *ci) const
+    CompilerInstance *ci, unsigned index) const
 {
     return std::unique_ptr<chimera::CompiledConfiguration>(
-        new CompiledConfiguration(*this, ci));
+        new CompiledConfiguration(*this, ci, index));
 }
 
 const YAML::Node &chimera::Configuration::GetRoot() const
@@ -164,22 +507,353 @@ const std::string &chimera::Configuration::GetOutputModuleName() const
     return outputModuleName_;
 }
 
+unsigned chimera::Configuration::GetJobs() const
+{
+    return jobs_;
+}
+
+unsigned chimera::Configuration::GetShards() const
+{
+    return shards_;
+}
+
+bool chimera::Configuration::GetMinimalIncludes() const
+{
+    return minimalIncludes_;
+}
+
+bool chimera::Configuration::GetIncremental() const
+{
+    return incremental_;
+}
+
+const std::string &chimera::Configuration::GetPreambleCachePath() const
+{
+    return preambleCachePath_;
+}
+
+std::vector<std::string> chimera::Configuration::GetOutputFiles() const
+{
+    std::lock_guard<std::mutex> lock(outputFilesMutex_);
+    return outputFiles_;
+}
+
+std::set<std::string> chimera::Configuration::GetDependencies() const
+{
+    std::set<std::string> dependencies;
+    {
+        std::lock_guard<std::mutex> lock(dependenciesMutex_);
+        dependencies = dependencies_;
+    }
+
+    if (!configFilename_.empty())
+        dependencies.insert(normalizePath(configFilename_));
+
+    std::lock_guard<std::mutex> lock(snippetsMutex_);
+    for (const auto &snippet : snippets_)
+        dependencies.insert(normalizePath(snippet.first));
+    return dependencies;
+}
+
+bool chimera::Configuration::IsUpToDate(const std::string &path,
+                                        const std::string &fingerprint) const
+{
+    if (fingerprint.empty())
+        return false;
+
+    const auto previous
+        = previousFingerprints_.find(path.substr(path.find_last_of("/") + 1));
+    return previous != previousFingerprints_.end()
+           && previous->second == fingerprint && llvm::sys::fs::exists(path);
+}
+
+void chimera::Configuration::ListOutputFile(const std::string &filename) const
+{
+    std::cout << filename << std::endl;
+
+    std::lock_guard<std::mutex> lock(outputFilesMutex_);
+    outputFiles_.push_back(filename);
+}
+
+void chimera::Configuration::AssignShards()
+{
+    std::vector<std::string> names;
+    std::vector<unsigned> costs;
+    for (const auto &binding : shardedBindings_)
+    {
+        names.push_back(binding.name);
+        costs.push_back(binding.cost);
+    }
+
+    const unsigned num_shards = GetShards();
+    shardAssignment_ = assignShards(names, costs, num_shards);
+
+    // A shard is up to date if it contains the same bindings, with the same
+    // fingerprints and in the same order.
+    std::vector<std::string> fingerprints(num_shards);
+    for (std::size_t i = 0; i < shardedBindings_.size(); ++i)
+        fingerprints[shardAssignment_[i]]
+            += shardedBindings_[i].fingerprint + "\n";
+
+    staleShards_.assign(num_shards, true);
+    if (GetIncremental())
+    {
+        for (unsigned shard = 0; shard < num_shards; ++shard)
+        {
+            const std::string shard_path = getShardPath(*this, shard);
+            const std::string fingerprint
+                = toHex(stableHash(fingerprints[shard]));
+            currentFingerprints_[shard_path.substr(
+                shard_path.find_last_of("/") + 1)]
+                = fingerprint;
+            staleShards_[shard] = !IsUpToDate(shard_path, fingerprint);
+        }
+    }
+}
+
+void chimera::Configuration::CheckUnresolved() const
+{
+    bool unresolved = false;
+    for (const auto &it : unresolvedEntries_)
+    {
+        if (it.second < resolvingTranslationUnits_)
+            continue;
+
+        std::cerr << it.first << std::endl;
+        unresolved = true;
+    }
+
+    if (unresolved)
+        exit(-2);
+}
+
+void chimera::Configuration::CheckOutputErrors() const
+{
+    for (const auto &error : outputErrors_)
+        std::cerr << error << std::endl;
+
+    if (!outputErrors_.empty())
+        exit(-6);
+}
+
+void chimera::Configuration::RenderModule()
+{
+    // Nothing is generated if no translation unit was processed.
+    if (!moduleInitialized_)
+        return;
+
+    // An entry of the configuration only needs to be found in one of the
+    // sources, since each of them may only declare some of the entries.
+    CheckUnresolved();
+
+    // The bindings are rendered by several threads, which leave the errors
+    // of the files they could not write to be reported here.
+    CheckOutputErrors();
+
+    // List the bindings of each translation unit in the order of the
+    // sources, regardless of the order in which they were rendered.
+    for (const auto &part : moduleParts_)
+        for (const auto &filename : part.filenames)
+            ListOutputFile(filename);
+
+    // Shards are written even if they are empty, so that the list of output
+    // files only depends on the number of shards.  Bindings keep the order
+    // in which they were claimed within a shard, and shards that are up to
+    // date are not written.
+    const unsigned num_shards = GetShards();
+    if (num_shards != 0)
+    {
+        AssignShards();
+
+        std::vector<std::string> contents(num_shards);
+        for (std::size_t i = 0; i < shardedBindings_.size(); ++i)
+            if (staleShards_[shardAssignment_[i]])
+                contents[shardAssignment_[i]] += shardedBindings_[i].content;
+
+        for (unsigned shard = 0; shard < num_shards; ++shard)
+        {
+            const std::string shard_path = getShardPath(*this, shard);
+            if (!staleShards_[shard])
+            {
+                ++chimera::util::OutputStats::unchanged;
+            }
+            else if (!chimera::util::writeFileIfChanged(shard_path,
+                                                        contents[shard]))
+            {
+                std::cerr << "Failed to create output file "
+                          << "'" << shard_path << "'." << std::endl;
+                exit(-6);
+            }
+            ListOutputFile(shard_path.substr(shard_path.find_last_of("/") + 1));
+        }
+    }
+
+    // Render the prelude header that is included by every binding, which
+    // uses the same snippets and sources as the bindings.  With minimal
+    // includes, each binding includes its own headers instead.
+    ::mstch::array prelude_sources;
+    if (!GetMinimalIncludes())
+        prelude_sources.assign(inputSourcePaths_.begin(),
+                               inputSourcePaths_.end());
+    ::mstch::map prelude_context{{"sources", prelude_sources}};
+    prelude_context.insert(fileContext_.begin(), fileContext_.end());
+    const std::string prelude_path = sanitizePath(
+        GetOutputPath() + "/" + GetOutputModuleName() + "_prelude.h");
+    if (!chimera::util::writeFileIfChanged(
+            prelude_path, ::mstch::render(preludeTemplate_, prelude_context)))
+    {
+        std::cerr << "Failed to create prelude header "
+                  << "'" << prelude_path << "'." << std::endl;
+        exit(-4);
+    }
+    ListOutputFile(prelude_path.substr(prelude_path.find_last_of("/") + 1));
+
+    // Create and sanitize path and filename of top-level source file.
+    // Because we may compress the filename to fit OS character limits,
+    // we generate the full path, then split the filename from it.
+    const std::string binding_path = sanitizePath(
+        GetOutputPath() + "/" + GetOutputModuleName() + ".cpp");
+    size_t path_index = binding_path.find_last_of("/");
+    const std::string binding_filename
+        = (path_index == std::string::npos)
+              ? ""
+              : binding_path.substr(path_index + 1);
+
+    // Create collections for the ordered sets of bindings, sources,
+    // and namespaces.  The bindings and namespaces of each translation unit
+    // follow those of the previous ones, and namespaces that were traversed
+    // by several of them are only listed once.
+    ::mstch::array binding_names;
+    ::mstch::array binding_namespaces;
+    std::set<std::string> namespace_names;
+    for (const auto &part : moduleParts_)
+    {
+        binding_names.insert(binding_names.end(), part.binding_names.begin(),
+                             part.binding_names.end());
+        for (const auto &binding_namespace : part.namespaces)
+        {
+            const auto &snapshot = boost::get<::mstch::map>(binding_namespace);
+            const auto it = snapshot.find("qualified_name");
+            const std::string *name
+                = (it == snapshot.end()) ? nullptr
+                                         : boost::get<std::string>(&it->second);
+            if (name && !namespace_names.insert(*name).second)
+                continue;
+            binding_namespaces.push_back(binding_namespace);
+        }
+    }
+    ::mstch::array binding_sources(inputSourcePaths_.begin(),
+                                   inputSourcePaths_.end());
+
+    // Create a top-level context that contains the extracted information
+    // about the module.
+    ::mstch::map full_context{
+        {"module",
+         ::mstch::map{{"name", GetOutputModuleName()},
+                      {"bindings", binding_names},
+                      {"sources", binding_sources},
+                      // Note: binding namespaces will be lexically ordered.
+                      {"namespaces", binding_namespaces}}}};
+
+    // Add customizable snippets that will be inserted into the file
+    // from the configuration file's "template::main" entry.
+    full_context.insert(mainContext_.begin(), mainContext_.end());
+
+    // Render the mstch template, and only replace the output file if its
+    // content changed.  If writing failed, report the error and fail.
+    const std::string content = ::mstch::render(moduleTemplate_, full_context);
+    if (!chimera::util::writeFileIfChanged(binding_path, content))
+    {
+        std::cerr << "Failed to create top-level output file "
+                  << "'" << binding_path << "'." << std::endl;
+        exit(-4);
+    }
+    ListOutputFile(binding_filename);
+
+    // Record the fingerprints of the generated files for the next run.  This
+    // is done last, so that files are regenerated if this run fails.
+    if (GetIncremental())
+    {
+        std::ofstream manifest(fingerprintsPath_);
+        for (const auto &it : currentFingerprints_)
+            manifest << it.second << " " << it.first << "\n";
+        if (manifest.fail())
+            std::cerr << "Warning: Failed to write fingerprints to "
+                      << "'" << fingerprintsPath_ << "'." << std::endl;
+    }
+}
+
 chimera::CompiledConfiguration::CompiledConfiguration(
-    const chimera::Configuration &parent, CompilerInstance *ci)
+    const chimera::Configuration &parent, CompilerInstance *ci, unsigned index)
   : parent_(parent)
+  , index_(index)
   , configNode_(parent.GetRoot())         // TODO: do we need this reference?
   , bindingNode_(configNode_["template"]) // TODO: is this always ok?
   , ci_(ci)
+  , eligibility_(ci)
 {
     // This placeholder will be filled in by the binding name specified
     // in the configuration YAML if it exists, or remain empty otherwise.
     std::string config_binding_name;
 
+    // Returns a section of the configuration YAML, which must be a map if it
+    // exists, or an undefined node otherwise.
+    auto getMapSection = [this](const std::string &name) -> YAML::Node {
+        if (!configNode_)
+            return YAML::Node(YAML::NodeType::Undefined);
+
+        const YAML::Node node = configNode_[name];
+        if (node && !node.IsMap())
+        {
+            std::cerr << "'" << name << "' in configuration YAML must be a map."
+                      << std::endl;
+            exit(-2);
+        }
+        return node;
+    };
+    const YAML::Node namespacesNode = getMapSection("namespaces");
+    const YAML::Node classesNode = getMapSection("classes");
+    const YAML::Node functionsNode = getMapSection("functions");
+    const YAML::Node typesNode = getMapSection("types");
+
+    // Count the translation units that resolve the configuration, so that
+    // only the entries that none of them can resolve are reported.
+    {
+        std::lock_guard<std::mutex> lock(parent_.unresolvedMutex_);
+        ++parent_.resolvingTranslationUnits_;
+    }
+
+    // Resolve all of the names in the configuration at once, since most of
+    // them can be found by name lookup, and parsing the others in a single
+    // buffer is much faster than parsing each of them on its own.  The
+    // results are used in the same order as the names are added below.
+    chimera::util::BatchResolver resolver(ci);
+    std::vector<std::size_t> indices;
+    for (const std::string &ns_str : parent.inputNamespaceNames_)
+        indices.push_back(resolver.AddNamespace(ns_str));
+    for (const auto &it : namespacesNode)
+        indices.push_back(resolver.AddNamespace(it.first.as<std::string>()));
+    for (const auto &it : classesNode)
+    {
+        // TODO: Use better way to detect if [decl_str] is template class type
+        const std::string decl_str = it.first.as<std::string>();
+        if (isClassTemplateString(decl_str))
+            indices.push_back(resolver.AddClassTemplate(decl_str));
+        else
+            indices.push_back(resolver.AddRecord(decl_str));
+    }
+    for (const auto &it : functionsNode)
+        indices.push_back(resolver.AddDeclaration(it.first.as<std::string>()));
+    for (const auto &it : typesNode)
+        indices.push_back(resolver.AddType(it.first.as<std::string>()));
+    resolver.Resolve();
+    auto index = indices.begin();
+
     // Resolve command-line namespaces.  Since these cannot include
     // configuration information, they are simpler to handle.
     for (const std::string &ns_str : parent.inputNamespaceNames_)
     {
-        auto ns = chimera::util::resolveNamespace(ci, ns_str);
+        auto ns = resolver.GetNamespace(*index++);
         if (!ns)
         {
             std::cerr << "Unable to resolve namespace: "
@@ -193,147 +867,99 @@ chimera::CompiledConfiguration::CompiledConfiguration(
     // If it is not available, then skip configuration node parsing.
     if (configNode_)
     {
-        // Parse 'namespaces' section of configuration YAML if it exists.
-        const YAML::Node &namespacesNode = configNode_["namespaces"];
-        if (namespacesNode)
+        // Resolve namespace configuration entries within provided AST.
+        for (const auto &it : namespacesNode)
         {
-            // Check that 'namespaces' node in configuration YAML is a map.
-            if (!namespacesNode.IsMap())
+            std::string ns_str = it.first.as<std::string>();
+            auto ns = resolver.GetNamespace(*index++);
+            if (ns)
             {
-                std::cerr << "'namespaces' in configuration YAML must be a map."
-                          << std::endl;
-                exit(-2);
-            }
-
-            // Resolve namespace configuration entries within provided AST.
-            for (const auto &it : namespacesNode)
-            {
-                std::string ns_str = it.first.as<std::string>();
-                auto ns = chimera::util::resolveNamespace(ci, ns_str);
-                if (ns)
+                if (it.second.IsNull())
                 {
-                    if (it.second.IsNull())
-                    {
-                        namespacesSuppressed_.insert(ns);
-                    }
-                    else
-                    {
-                        declarations_[ns] = it.second;
-                        namespacesIncluded_.insert(ns);
-                    }
+                    namespacesSuppressed_.insert(ns);
                 }
                 else
                 {
-                    std::cerr << "Unable to resolve namespace: "
-                              << "'" << ns_str << "'." << std::endl;
-                    exit(-2);
+                    declarations_[ns] = it.second;
+                    namespacesIncluded_.insert(ns);
                 }
             }
+            else
+            {
+                ReportUnresolved("Unable to resolve namespace: '" + ns_str
+                                 + "'.");
+            }
         }
 
-        // Parse 'classes' section of configuration YAML if it exists.
-        const YAML::Node &classesNode = configNode_["classes"];
-        if (classesNode)
+        // Parse 'files' section of configuration YAML if it exists.
+        // This restricts the traversal to the listed files and directories.
+        const YAML::Node &filesNode = configNode_["files"];
+        if (filesNode)
         {
-            // Check that 'classes' node in configuration YAML is a map.
-            if (!classesNode.IsMap())
+            // Check that 'files' node in configuration YAML is a sequence.
+            if (!filesNode.IsSequence())
             {
-                std::cerr << "'classes' in configuration YAML must be a map."
+                std::cerr << "'files' in configuration YAML must be a sequence."
                           << std::endl;
                 exit(-2);
             }
 
-            // Resolve class/struct configuration entries within provided AST.
-            for (const auto &it : configNode_["classes"])
+            for (const auto &it : filesNode)
             {
-                std::string decl_str = it.first.as<std::string>();
-
-                // TODO: Use better way to detect if [decl_str] is template
-                // class type
-                if (util::startsWith(decl_str, "template ")
-                    || util::startsWith(decl_str, "template<"))
-                {
-                    auto decl
-                        = chimera::util::resolveClassTemplate(ci, decl_str);
-                    if (decl)
-                    {
-                        declarations_[decl] = it.second;
-                        continue;
-                    }
-                }
-                else
-                {
-                    auto decl = chimera::util::resolveRecord(ci, decl_str);
-                    if (decl)
-                    {
-                        declarations_[decl] = it.second;
-                        continue;
-                    }
-                }
-
-                std::cerr << "Unable to resolve class declaration: "
-                          << "'" << decl_str << "'" << std::endl;
-                exit(-2);
+                files_.push_back(normalizePath(resolveConfigPath(
+                    parent.GetConfigFilename(), it.as<std::string>())));
             }
         }
 
-        // Parse 'functions' section of configuration YAML if it exists.
-        const YAML::Node &functionsNode = configNode_["functions"];
-        if (functionsNode)
+        // Resolve class/struct configuration entries within provided AST.
+        for (const auto &it : classesNode)
         {
-            // Check that 'functions' node in configuration YAML is a map.
-            if (!functionsNode.IsMap())
+            std::string decl_str = it.first.as<std::string>();
+            const clang::Decl *decl
+                = isClassTemplateString(decl_str)
+                      ? static_cast<const clang::Decl *>(
+                            resolver.GetClassTemplate(*index++))
+                      : resolver.GetRecord(*index++);
+            if (!decl)
             {
-                std::cerr << "'functions' in configuration YAML must be a map."
-                          << std::endl;
-                exit(-2);
+                ReportUnresolved("Unable to resolve class declaration: '"
+                                 + decl_str + "'");
+                continue;
             }
+            declarations_[decl] = it.second;
+        }
 
-            // Resolve function configuration entries within provided AST.
-            for (const auto &it : functionsNode)
+        // Resolve function configuration entries within provided AST.
+        for (const auto &it : functionsNode)
+        {
+            std::string decl_str = it.first.as<std::string>();
+            auto decl = resolver.GetDeclaration(*index++);
+            if (decl)
             {
-                std::string decl_str = it.first.as<std::string>();
-                auto decl = chimera::util::resolveDeclaration(ci, decl_str);
-                if (decl)
-                {
-                    declarations_[decl] = it.second;
-                }
-                else
-                {
-                    std::cerr << "Unable to resolve function declaration: "
-                              << "'" << decl_str << "'" << std::endl;
-                    exit(-2);
-                }
+                declarations_[decl] = it.second;
+            }
+            else
+            {
+                ReportUnresolved("Unable to resolve function declaration: '"
+                                 + decl_str + "'");
             }
         }
 
-        // Parse 'types' section of configuration YAML if it exists.
-        const YAML::Node &typesNode = configNode_["types"];
-        if (typesNode)
+        // Resolve type configuration entries within provided AST.
+        for (const auto &it : typesNode)
         {
-            // Check that 'types' node in configuration YAML is a map.
-            if (!typesNode.IsMap())
+            std::string type_str = it.first.as<std::string>();
+            auto type = resolver.GetType(*index++);
+            if (type.getTypePtrOrNull())
             {
-                std::cerr << "'types' in configuration YAML must be a map."
-                          << std::endl;
-                exit(-2);
+                // The first entry of a type takes precedence.
+                types_.insert(
+                    std::make_pair(type.getCanonicalType(), it.second));
             }
-
-            // Resolve type configuration entries within provided AST.
-            for (const auto &it : typesNode)
+            else
             {
-                std::string type_str = it.first.as<std::string>();
-                auto type = chimera::util::resolveType(ci, type_str);
-                if (type.getTypePtrOrNull())
-                {
-                    types_.emplace_back(std::make_pair(type, it.second));
-                }
-                else
-                {
-                    std::cerr << "Unable to resolve type: "
-                              << "'" << type_str << "'" << std::endl;
-                    exit(-2);
-                }
+                ReportUnresolved("Unable to resolve type: '" + type_str
+                                 + "'");
             }
         }
 
@@ -382,95 +1008,173 @@ chimera::CompiledConfiguration::CompiledConfiguration(
     if (bindingNode_)
     {
         if (const YAML::Node &classTemplateNode = bindingNode_["class"])
+        {
             bindingDefinition_.class_cpp = Lookup(classTemplateNode);
+            bindingDefinition_.class_render = nullptr;
+        }
 
         if (const YAML::Node &enumTemplateNode = bindingNode_["enum"])
+        {
             bindingDefinition_.enum_cpp = Lookup(enumTemplateNode);
+            bindingDefinition_.enum_render = nullptr;
+        }
 
         if (const YAML::Node &functionTemplateNode = bindingNode_["function"])
+        {
             bindingDefinition_.function_cpp = Lookup(functionTemplateNode);
+            bindingDefinition_.function_render = nullptr;
+        }
 
         if (const YAML::Node &moduleTemplateNode = bindingNode_["module"])
+        {
             bindingDefinition_.module_cpp = Lookup(moduleTemplateNode);
+            bindingDefinition_.module_render = nullptr;
+        }
+
+        if (const YAML::Node &preludeTemplateNode = bindingNode_["prelude"])
+        {
+            bindingDefinition_.prelude_h = Lookup(preludeTemplateNode);
+            bindingDefinition_.prelude_render = nullptr;
+        }
 
         if (const YAML::Node &variableTemplateNode = bindingNode_["variable"])
+        {
             bindingDefinition_.variable_cpp = Lookup(variableTemplateNode);
+            bindingDefinition_.variable_render = nullptr;
+        }
     }
 
-    // Set custom escape function that disables HTML escaping on mstch output.
-    //
-    // This is not desirable in chimera because many C++ types include
-    // characters that can be accidentally escaped, such as `<>` and `&`.
-    //
-    // See: https://github.com/no1msd/mstch#custom-escape-function
-    //
-    ::mstch::config::escape
-        = [](const std::string &str) -> std::string { return str; };
-}
-
-chimera::CompiledConfiguration::~CompiledConfiguration()
-{
-    // Create and sanitize path and filename of top-level source file.
-    // Because we may compress the filename to fit OS character limits,
-    // we generate the full path, then split the filename from it.
-    const std::string binding_path = sanitizePath(
-        parent_.GetOutputPath() + "/" + parent_.GetOutputModuleName() + ".cpp");
-    size_t path_index = binding_path.find_last_of("/");
-    const std::string binding_filename
-        = (path_index == std::string::npos)
-              ? ""
-              : binding_path.substr(path_index + 1);
-
-    // Create an output file depending on the provided parameters.
-    auto stream = ci_->createOutputFile(
-        binding_path,
-        false, // Open the file in binary mode
-        false, // Register with llvm::sys::RemoveFileOnSignal
-        "",    // The derived basename (shouldn't be used)
-        "",    // The extension to use for derived name (shouldn't be used)
-        false, // Use a temporary file that should be renamed
-        false  // Create missing directories in the output path
-    );
+    // Convert the configuration of each declaration and the snippets from
+    // the "template::file" and "template::main" entries once, since they
+    // are the same for every binding that is rendered.
+    for (const auto &it : declarations_)
+    {
+        ::mstch::map context;
+        chimera::util::extendWithYAMLNode(context, it.second);
+        declarationContexts_[it.first]
+            = ::mstch::object::make_constants(context);
+    }
+    if (bindingNode_)
+    {
+        const auto lookup = std::bind(&chimera::CompiledConfiguration::Lookup,
+                                      this, std::placeholders::_1);
+        chimera::util::extendWithYAMLNode(fileContext_, bindingNode_["file"],
+                                          false, lookup);
+        chimera::util::extendWithYAMLNode(mainContext_, bindingNode_["main"],
+                                          false, lookup);
+    }
 
-    // If file creation failed, report the error and fail immediately.
-    if (!stream)
+    // Tokenize each of the templates once, since they will be rendered for
+    // every declaration that is traversed.  Built-in templates that were
+    // compiled ahead of time are used directly instead.
+    classTemplate_ = compileTemplate(bindingDefinition_.class_cpp,
+                                     bindingDefinition_.class_render);
+    enumTemplate_ = compileTemplate(bindingDefinition_.enum_cpp,
+                                    bindingDefinition_.enum_render);
+    functionTemplate_ = compileTemplate(bindingDefinition_.function_cpp,
+                                        bindingDefinition_.function_render);
+    moduleTemplate_ = compileTemplate(bindingDefinition_.module_cpp,
+                                      bindingDefinition_.module_render);
+    preludeTemplate_ = compileTemplate(bindingDefinition_.prelude_h,
+                                       bindingDefinition_.prelude_render);
+    variableTemplate_ = compileTemplate(bindingDefinition_.variable_cpp,
+                                        bindingDefinition_.variable_render);
+
+    // The common includes of the bindings are rendered into a prelude header,
+    // which every binding includes first so that it can be precompiled.
+    const std::string prelude_path
+        = sanitizePath(parent_.GetOutputPath() + "/"
+                       + parent_.GetOutputModuleName() + "_prelude.h");
+    fileContext_["prelude"]
+        = prelude_path.substr(prelude_path.find_last_of("/") + 1);
+
+    // Fingerprint everything that every binding depends on.
+    if (parent_.GetIncremental())
     {
-        std::cerr << "Failed to create top-level output file "
-                  << "'" << binding_path << "'." << std::endl;
-        exit(-4);
+        std::stringstream global;
+        global << CHIMERA_MAJOR_VERSION << "." << CHIMERA_MINOR_VERSION << "."
+               << CHIMERA_PATCH_VERSION << "\n"
+               << YAML::Dump(configNode_) << "\n"
+               << binding_name_ << "\n"
+               << bindingDefinition_.class_cpp << bindingDefinition_.enum_cpp
+               << bindingDefinition_.function_cpp
+               << bindingDefinition_.variable_cpp << "\n"
+               << parent_.GetOutputModuleName() << "\n"
+               << parent_.GetShards() << parent_.GetMinimalIncludes() << "\n";
+        for (const auto &path : parent_.inputSourcePaths_)
+            global << path << "\n";
+        {
+            std::lock_guard<std::mutex> lock(parent_.snippetsMutex_);
+            for (const auto &snippet : parent_.snippets_)
+                global << snippet.first << "\n" << snippet.second << "\n";
+        }
+        for (const auto &macro : ci_->getPreprocessorOpts().Macros)
+            global << macro.first << macro.second << "\n";
+        for (const auto &entry : ci_->getHeaderSearchOpts().UserEntries)
+            global << entry.Path << "\n";
+        globalFingerprint_ = toHex(stableHash(global.str()));
     }
 
-    // Create collections for the ordered sets of bindings, sources,
-    // and namespaces.
-    ::mstch::array binding_names(binding_names_.begin(), binding_names_.end());
-    ::mstch::array binding_namespaces(binding_namespaces_.begin(),
-                                      binding_namespaces_.end());
-    ::mstch::array binding_sources(parent_.inputSourcePaths_.begin(),
-                                   parent_.inputSourcePaths_.end());
+    // The first translation unit initializes the top-level module, which is
+    // rendered once every translation unit has been processed, and loads the
+    // fingerprints of the files that were generated by the previous run.
+    std::lock_guard<std::mutex> lock(parent_.moduleMutex_);
+    if (parent_.moduleInitialized_)
+        return;
+
+    parent_.moduleTemplate_ = moduleTemplate_;
+    parent_.preludeTemplate_ = preludeTemplate_;
+    parent_.fileContext_ = fileContext_;
+    parent_.mainContext_ = mainContext_;
+    if (parent_.GetIncremental())
+    {
+        parent_.fingerprintsPath_
+            = sanitizePath(parent_.GetOutputPath() + "/"
+                           + parent_.GetOutputModuleName() + ".fingerprints");
+        std::ifstream manifest(parent_.fingerprintsPath_);
+        std::string fingerprint;
+        std::string filename;
+        while (manifest >> fingerprint && std::getline(manifest >> std::ws,
+                                                       filename))
+            parent_.previousFingerprints_[filename] = fingerprint;
+    }
+    parent_.moduleInitialized_ = true;
+}
 
-    // Create a top-level context that contains the extracted information
-    // about the module.
-    ::mstch::map full_context{
-        {"module",
-         ::mstch::map{{"name", parent_.GetOutputModuleName()},
-                      {"bindings", binding_names},
-                      {"sources", binding_sources},
-                      // Note: binding namespaces will be lexically ordered.
-                      {"namespaces", binding_namespaces}}}};
+chimera::CompiledConfiguration::~CompiledConfiguration()
+{
+    // Finish any bindings that are still queued, since they are listed in the
+    // top-level module.
+    RenderQueued();
 
-    // Resolve customizable snippets that will be inserted into the file
-    // from the configuration file's "template::main" entry.
-    if (bindingNode_)
+    // Record every file that was loaded while parsing, since the bindings
+    // must be regenerated if any of them changes.
     {
-        chimera::util::extendWithYAMLNode(
-            full_context, bindingNode_["main"], false,
-            std::bind(&chimera::CompiledConfiguration::Lookup, this,
-                      std::placeholders::_1));
+        const SourceManager &source_manager = ci_->getSourceManager();
+        std::lock_guard<std::mutex> lock(parent_.dependenciesMutex_);
+        for (auto it = source_manager.fileinfo_begin();
+             it != source_manager.fileinfo_end(); ++it)
+            parent_.dependencies_.insert(
+                normalizePath(std::string(it->first->getName())));
     }
 
-    // Render the mstch template to the given output file.
-    *stream << ::mstch::render(bindingDefinition_.module_cpp, full_context);
-    std::cout << binding_filename << std::endl;
+    // Contribute the bindings, namespaces and files of this translation unit
+    // to the top-level module, which is rendered once every translation unit
+    // has been processed.  The namespaces are converted to values, including
+    // the entries of their YAML configuration, since the AST is destroyed
+    // with this configuration.
+    Configuration::ModulePart part;
+    part.binding_names = binding_names_;
+    for (const auto &binding_namespace : binding_namespaces_)
+        part.namespaces.push_back(snapshotNode(binding_namespace));
+    part.filenames = filenames_;
+
+    std::lock_guard<std::mutex> lock(parent_.moduleMutex_);
+    if (index_ >= parent_.moduleParts_.size())
+        parent_.moduleParts_.resize(index_ + 1);
+    parent_.moduleParts_[index_] = std::move(part);
+    parent_.currentFingerprints_.insert(currentFingerprints_.begin(),
+                                        currentFingerprints_.end());
 }
 
 void chimera::CompiledConfiguration::AddTraversedNamespace(
@@ -517,16 +1221,19 @@ const YAML::Node &chimera::CompiledConfiguration::GetDeclaration(
     return d != declarations_.end() ? d->second : emptyNode_;
 }
 
+std::shared_ptr<const ::mstch::object::constant_map>
+chimera::CompiledConfiguration::GetDeclarationContext(
+    const clang::Decl *decl) const
+{
+    const auto d = declarationContexts_.find(decl->getCanonicalDecl());
+    return d != declarationContexts_.end() ? d->second : nullptr;
+}
+
 const YAML::Node &chimera::CompiledConfiguration::GetType(
     const clang::QualType type) const
 {
-    const auto canonical_type = type.getCanonicalType();
-    for (const auto &entry : types_)
-    {
-        if (entry.first == canonical_type)
-            return entry.second;
-    }
-    return emptyNode_;
+    const auto t = types_.find(type.getCanonicalType());
+    return t != types_.end() ? t->second : emptyNode_;
 }
 
 clang::CompilerInstance *chimera::CompiledConfiguration::GetCompilerInstance()
@@ -540,30 +1247,340 @@ clang::ASTContext &chimera::CompiledConfiguration::GetContext() const
     return ci_->getASTContext();
 }
 
+chimera::EligibilityAnalysis &chimera::CompiledConfiguration::GetEligibility()
+    const
+{
+    return eligibility_;
+}
+
+std::recursive_mutex &chimera::CompiledConfiguration::GetASTMutex() const
+{
+    return astMutex_;
+}
+
 const std::string &chimera::CompiledConfiguration::GetBindingName() const
 {
     return binding_name_;
 }
 
+::mstch::node chimera::CompiledConfiguration::GetSharedNode(
+    const std::string &name, const clang::Decl *decl,
+    const std::function<::mstch::node()> &generate) const
+{
+    const auto key = std::make_pair(name, decl);
+    {
+        std::lock_guard<std::mutex> lock(sharedNodesMutex_);
+        auto it = sharedNodes_.find(key);
+        if (it != sharedNodes_.end())
+            return it->second;
+    }
+
+    // Generate the value without holding the lock, since generating it may
+    // request other shared values.  If two threads generate the same value,
+    // the first one is kept.
+    ::mstch::node value = generate();
+
+    std::lock_guard<std::mutex> lock(sharedNodesMutex_);
+    return sharedNodes_.emplace(key, std::move(value)).first->second;
+}
+
 bool chimera::CompiledConfiguration::IsEnclosed(const clang::Decl *decl) const
 {
-    // Skip namespaces that are defined as null in the configuration.
-    for (const auto &it : GetNamespacesSuppressed())
+    const DeclContext *context = decl->getDeclContext();
+    return context && GetContextVerdict(context).enclosed;
+}
+
+bool chimera::CompiledConfiguration::IsPruned(const clang::Decl *decl) const
+{
+    // Skip declarations from files that are not in the allowlist.
+    if (!files_.empty() && !IsInAllowedFile(decl))
+        return true;
+
+    // Other declarations have the same enclosing context as their children,
+    // so if they are not enclosed, neither are their children.
+    const auto *context = dyn_cast<DeclContext>(decl);
+    if (!context)
+        return !IsEnclosed(decl);
+
+    return GetContextVerdict(context).pruned;
+}
+
+chimera::CompiledConfiguration::ContextVerdict
+chimera::CompiledConfiguration::GetContextVerdict(
+    const clang::DeclContext *context) const
+{
+    // The verdict only depends on the primary context, since all of the
+    // contexts of a namespace enclose and are enclosed by the same contexts.
+    context = context->getPrimaryContext();
     {
-        if (decl->getDeclContext() && it->Encloses(decl->getDeclContext()))
-            return false;
+        std::lock_guard<std::mutex> lock(contextVerdictsMutex_);
+        const auto cached = contextVerdicts_.find(context);
+        if (cached != contextVerdicts_.end())
+            return cached->second;
     }
 
+    // Skip namespaces that are defined as null in the configuration.
+    const bool suppressed = std::any_of(
+        namespacesSuppressed_.begin(), namespacesSuppressed_.end(),
+        [context](const NamespaceDecl *ns) { return ns->Encloses(context); });
+
+    ContextVerdict verdict;
+
     // Filter over the namespaces and only traverse ones that are enclosed
     // by one of the configuration namespaces.
-    for (const auto &it : GetNamespacesIncluded())
+    verdict.enclosed
+        = !suppressed
+          && std::any_of(namespacesIncluded_.begin(), namespacesIncluded_.end(),
+                         [context](const NamespaceDecl *ns) {
+                             return ns->Encloses(context);
+                         });
+
+    // A declaration context can only contain generated declarations if it is
+    // enclosed by a configured namespace, or if it encloses one.  This skips
+    // system headers, std, boost and any other unrelated code.
+    verdict.pruned
+        = suppressed
+          || std::none_of(namespacesIncluded_.begin(),
+                          namespacesIncluded_.end(),
+                          [context](const NamespaceDecl *ns) {
+                              return ns->Encloses(context)
+                                     || context->Encloses(ns);
+                          });
+
+    std::lock_guard<std::mutex> lock(contextVerdictsMutex_);
+    contextVerdicts_[context] = verdict;
+    return verdict;
+}
+
+void chimera::CompiledConfiguration::ReportUnresolved(
+    const std::string &message) const
+{
+    // A single translation unit must resolve every entry, which is reported
+    // before anything is generated.
+    if (parent_.traversed_.size() <= 1)
     {
-        if (decl->getDeclContext() && it->Encloses(decl->getDeclContext()))
+        std::cerr << message << std::endl;
+        exit(-2);
+    }
+
+    std::lock_guard<std::mutex> lock(parent_.unresolvedMutex_);
+    ++parent_.unresolvedEntries_[message];
+}
+
+bool chimera::CompiledConfiguration::IsInAllowedFile(
+    const clang::Decl *decl) const
+{
+    // Declarations without a file (e.g. builtins) are always allowed.
+    const SourceManager &source_manager = ci_->getSourceManager();
+    const SourceLocation location
+        = source_manager.getExpansionLoc(decl->getLocation());
+    if (location.isInvalid())
+        return true;
+
+    // Resolve each file once, since most files contain many declarations.
+    const FileID file = source_manager.getFileID(location);
+    const auto cached = allowedFiles_.find(file);
+    if (cached != allowedFiles_.end())
+        return cached->second;
+
+    bool allowed = true;
+    if (const FileEntry *entry = source_manager.getFileEntryForID(file))
+    {
+        const std::string path = normalizePath(std::string(entry->getName()));
+        allowed = std::any_of(
+            files_.begin(), files_.end(), [&path](const std::string &prefix) {
+                // Entries match the same file or any file in a directory.
+                return path.compare(0, prefix.size(), prefix) == 0
+                       && (path.size() == prefix.size()
+                           || path[prefix.size()] == '/');
+            });
+    }
+    allowedFiles_[file] = allowed;
+    return allowed;
+}
+
+::mstch::array chimera::CompiledConfiguration::GetRequiredHeaders(
+    const clang::NamedDecl *decl)
+{
+    ::mstch::array headers;
+    for (const FileEntry *file :
+         chimera::util::getRequiredFiles(ci_->getSourceManager(), decl))
+    {
+        // Resolve the name of each file once, since most files are required
+        // by many bindings.
+        auto cached = headerNames_.find(file);
+        if (cached == headerNames_.end())
         {
-            return true;
+            // Source files are included by the path they were given as, like
+            // in the "sources" list.  Other files are included by the
+            // shortest path that the header search finds them with.
+            FileManager &file_manager = ci_->getFileManager();
+            const auto source = std::find_if(
+                parent_.inputSourcePaths_.begin(),
+                parent_.inputSourcePaths_.end(),
+                [&file_manager, file](const std::string &path) {
+                    return file_manager.getFile(path) == file;
+                });
+            const std::string name
+                = (source != parent_.inputSourcePaths_.end())
+                      ? *source
+                      : ci_->getPreprocessor()
+                            .getHeaderSearchInfo()
+                            .suggestPathToFileForDiagnostics(file);
+            cached = headerNames_.insert(std::make_pair(file, name)).first;
         }
+        headers.push_back(cached->second);
     }
-    return false;
+    return headers;
+}
+
+uint64_t chimera::CompiledConfiguration::GetSourceFingerprint(
+    const clang::Decl *decl, std::vector<const clang::Decl *> &references)
+{
+    // The source text of a class is that of its definition.
+    const Decl *definition = decl;
+    if (auto tag_decl = dyn_cast<TagDecl>(decl))
+    {
+        if (const TagDecl *tag_definition = tag_decl->getDefinition())
+            definition = tag_definition;
+    }
+
+    const SourceManager &source_manager = ci_->getSourceManager();
+    const SourceLocation location
+        = source_manager.getExpansionLoc(definition->getLocation());
+    if (location.isValid() && source_manager.isInSystemHeader(location))
+    {
+        std::stringstream file_id;
+        if (const FileEntry *file = source_manager.getFileEntryForID(
+                source_manager.getFileID(location)))
+            file_id << std::string(file->getName()) << "\n"
+                    << file->getSize() << "\n" << file->getModificationTime();
+        return stableHash(file_id.str());
+    }
+
+    // The file is included, since it is the header that is included for the
+    // declaration with minimal includes.
+    std::string data;
+    if (const FileEntry *file = source_manager.getFileEntryForID(
+            source_manager.getFileID(location)))
+        data = std::string(file->getName()) + "\n";
+
+    const SourceRange range = definition->getSourceRange();
+    data += Lexer::getSourceText(
+        CharSourceRange::getTokenRange(
+            source_manager.getExpansionLoc(range.getBegin()),
+            source_manager.getExpansionLoc(range.getEnd())),
+        source_manager, ci_->getLangOpts());
+
+    for (const Decl *referenced_decl :
+         chimera::util::getReferencedDecls(definition))
+        references.push_back(referenced_decl->getCanonicalDecl());
+    return stableHash(data);
+}
+
+uint64_t chimera::CompiledConfiguration::GetFingerprint(
+    const clang::Decl *decl)
+{
+    decl = decl->getCanonicalDecl();
+    const auto cached = fingerprints_.find(decl);
+    if (cached != fingerprints_.end())
+        return cached->second;
+
+    // Declarations may refer to each other, so the declarations that are
+    // reachable from this one are split into strongly connected components
+    // with Tarjan's algorithm.  Every declaration of a component gets the
+    // same fingerprint, which combines the sorted source fingerprints of its
+    // members with the sorted fingerprints of the components that they refer
+    // to, so that it neither depends on the order in which declarations are
+    // visited nor misses a change in any reachable declaration.  Only these
+    // final fingerprints are cached.
+    struct Visit
+    {
+        unsigned index;
+        unsigned low_link;
+        bool on_stack;
+        uint64_t source_fingerprint;
+        std::vector<const Decl *> references;
+    };
+    std::unordered_map<const Decl *, Visit> visits;
+    std::vector<const Decl *> stack;
+
+    std::function<void(const Decl *)> visit = [&](const Decl *current) {
+        Visit &node = visits[current];
+        node.index = node.low_link = static_cast<unsigned>(visits.size() - 1);
+        node.on_stack = true;
+        node.source_fingerprint
+            = GetSourceFingerprint(current, node.references);
+        stack.push_back(current);
+
+        // References of a visit are not modified after this point, and
+        // entries of an unordered_map are not moved by insertions.
+        for (const Decl *referenced_decl : node.references)
+        {
+            if (fingerprints_.count(referenced_decl))
+                continue;
+
+            const auto it = visits.find(referenced_decl);
+            if (it == visits.end())
+            {
+                visit(referenced_decl);
+                node.low_link
+                    = std::min(node.low_link, visits[referenced_decl].low_link);
+            }
+            else if (it->second.on_stack)
+            {
+                node.low_link = std::min(node.low_link, it->second.index);
+            }
+        }
+
+        if (node.low_link != node.index)
+            return;
+
+        // This declaration is the root of a component, whose members are on
+        // top of the stack.  Components that they refer to are complete.
+        std::vector<const Decl *> members;
+        do
+        {
+            members.push_back(stack.back());
+            visits[stack.back()].on_stack = false;
+            stack.pop_back();
+        } while (members.back() != current);
+
+        std::vector<uint64_t> source_fingerprints;
+        std::vector<uint64_t> referenced_fingerprints;
+        for (const Decl *member : members)
+        {
+            const Visit &member_node = visits[member];
+            source_fingerprints.push_back(member_node.source_fingerprint);
+            for (const Decl *referenced_decl : member_node.references)
+            {
+                const auto it = fingerprints_.find(referenced_decl);
+                if (it != fingerprints_.end())
+                    referenced_fingerprints.push_back(it->second);
+            }
+        }
+        std::sort(source_fingerprints.begin(), source_fingerprints.end());
+        std::sort(referenced_fingerprints.begin(),
+                  referenced_fingerprints.end());
+        referenced_fingerprints.erase(
+            std::unique(referenced_fingerprints.begin(),
+                        referenced_fingerprints.end()),
+            referenced_fingerprints.end());
+
+        std::string data;
+        for (const uint64_t fingerprint : source_fingerprints)
+            data += toHex(fingerprint) + "\n";
+        data += "\n";
+        for (const uint64_t fingerprint : referenced_fingerprints)
+            data += toHex(fingerprint) + "\n";
+
+        const uint64_t fingerprint = stableHash(data);
+        for (const Decl *member : members)
+            fingerprints_[member] = fingerprint;
+    };
+    visit(decl);
+
+    return fingerprints_[decl];
 }
 
 bool chimera::CompiledConfiguration::IsSuppressed(const QualType type) const
@@ -667,25 +1684,15 @@ std::string chimera::CompiledConfiguration::Lookup(const YAML::Node &node) const
     // If the node type tag is "!file" then load the contents of a file.
     if (node.Tag() == "!file")
     {
-        // Get reference to path to configuration file itself.
-        const std::string &config_path = parent_.GetConfigFilename();
-
         // Concatenate YAML filepath with source relative path.
-        // TODO: this is somewhat brittle.
-        std::string source_path = node.as<std::string>();
+        const std::string source_path = resolveConfigPath(
+            parent_.GetConfigFilename(), node.as<std::string>());
 
-        if (source_path.front() != '/')
-        {
-            std::size_t found = config_path.rfind("/");
-            if (found != std::string::npos)
-            {
-                source_path = config_path.substr(0, found) + "/" + source_path;
-            }
-            else
-            {
-                source_path = "./" + source_path;
-            }
-        }
+        // Each file is only read the first time it is referenced.
+        std::lock_guard<std::mutex> lock(parent_.snippetsMutex_);
+        const auto it = parent_.snippets_.find(source_path);
+        if (it != parent_.snippets_.end())
+            return it->second;
 
         // Try to open configuration file.
         std::ifstream source(source_path);
@@ -700,6 +1707,7 @@ std::string chimera::CompiledConfiguration::Lookup(const YAML::Node &node) const
         std::string snippet;
         snippet.assign(std::istreambuf_iterator<char>(source),
                        std::istreambuf_iterator<char>());
+        parent_.snippets_[source_path] = snippet;
         return snippet;
     }
 
@@ -708,9 +1716,14 @@ std::string chimera::CompiledConfiguration::Lookup(const YAML::Node &node) const
 }
 
 bool chimera::CompiledConfiguration::Render(
-    std::string view, std::string key,
-    const std::shared_ptr<::mstch::object> &context)
+    const ::mstch::compiled_template &view, const std::string &key,
+    const std::shared_ptr<::mstch::object> &context,
+    const clang::NamedDecl *decl)
 {
+    static const ::mstch::compiled_template mangled_name_template(
+        "{{mangled_name}}");
+    static const ::mstch::compiled_template name_template("{{name}}");
+
     // Get the mangled name property if it exists.
     if (!context->has("mangled_name"))
     {
@@ -718,7 +1731,17 @@ bool chimera::CompiledConfiguration::Render(
                   << std::endl;
         return false;
     }
-    std::string mangled_name = ::mstch::render("{{mangled_name}}", context);
+    std::string mangled_name = ::mstch::render(mangled_name_template, context);
+
+    // Skip bindings that were already generated by this or a previous
+    // translation unit, since the sources may include the same headers.  The
+    // mangled name identifies a declaration by its canonical qualified name
+    // and its signature.
+    {
+        std::lock_guard<std::mutex> lock(parent_.traversalMutex_);
+        if (!parent_.claimedBindings_.insert(mangled_name).second)
+            return true;
+    }
 
     // Create and sanitize path and filename of top-level source file.
     // Because we may compress the filename to fit OS character limits,
@@ -731,28 +1754,6 @@ bool chimera::CompiledConfiguration::Render(
               ? ""
               : binding_path.substr(path_index + 1);
 
-    // Create an output file depending on the provided parameters.
-    auto stream = ci_->createOutputFile(
-        binding_path,
-        false, // Open the file in binary mode
-        false, // Register with llvm::sys::RemoveFileOnSignal
-        "",    // The derived basename (shouldn't be used)
-        "",    // The extension to use for derived name (shouldn't be used)
-        false, // Use a temporary file that should be renamed
-        false  // Create missing directories in the output path
-    );
-
-    // If file creation failed, report the error and fail immediately.
-    if (!stream)
-    {
-        std::cerr << "Failed to create output file "
-                  << "'" << binding_path << "'"
-                  << " for "
-                  << "'" << ::mstch::render("{{name}}", context) << "'."
-                  << std::endl;
-        exit(-6);
-    }
-
     // Create collections for the ordered sets of sources.
     ::mstch::array binding_sources(parent_.inputSourcePaths_.begin(),
                                    parent_.inputSourcePaths_.end());
@@ -761,45 +1762,180 @@ bool chimera::CompiledConfiguration::Render(
     // about this particular binding component.
     ::mstch::map full_context{{key, context}, {"sources", binding_sources}};
 
-    // Resolve customizable snippets that will be inserted into the file
+    // Add the headers that this binding requires, unless the prelude
+    // includes all of the sources.
+    if (parent_.GetMinimalIncludes())
+        full_context["headers"] = GetRequiredHeaders(decl);
+
+    // Add customizable snippets that will be inserted into the file
     // from the configuration file's "template::file" entry.
-    if (bindingNode_)
+    full_context.insert(fileContext_.begin(), fileContext_.end());
+
+    // Queue the binding to be rendered by RenderQueued(), which may run on
+    // another thread.  Bindings that are packed into shards are written by
+    // Configuration::RenderModule() instead, once it is known which shards
+    // changed.
+    const bool sharded = (parent_.GetShards() != 0);
+    QueuedBinding binding;
+    binding.render = [&view, context, full_context, binding_path,
+                      sharded](std::string &error) {
+        // Render the mstch template, and only replace the output file if its
+        // content changed.  If writing failed, describe the error, which is
+        // reported once every binding has been rendered.
+        std::string content = ::mstch::render(view, full_context);
+        if (!sharded
+            && !chimera::util::writeFileIfChanged(binding_path, content))
+        {
+            error = "Failed to create output file '" + binding_path
+                    + "' for '" + ::mstch::render(name_template, context)
+                    + "'.";
+        }
+        return content;
+    };
+    binding.filename = binding_filename;
+    binding.path = binding_path;
+    binding.shard_index = 0;
+    if (parent_.GetIncremental())
+        binding.fingerprint = toHex(
+            stableHash(globalFingerprint_ + "\n" + key + "\n" + mangled_name
+                       + "\n" + toHex(GetFingerprint(decl))));
+    if (sharded)
     {
-        chimera::util::extendWithYAMLNode(
-            full_context, bindingNode_["file"], false,
-            std::bind(&chimera::CompiledConfiguration::Lookup, this,
-                      std::placeholders::_1));
+        std::lock_guard<std::mutex> lock(parent_.moduleMutex_);
+        binding.shard_index = parent_.shardedBindings_.size();
+        parent_.shardedBindings_.push_back(
+            {mangled_name, chimera::util::estimateCompileCost(decl),
+             binding.fingerprint, std::string()});
     }
+    render_queue_.push_back(std::move(binding));
 
-    // Render the mstch template to the given output file.
-    *stream << ::mstch::render(view, full_context);
-    std::cout << binding_filename << std::endl;
-
-    // Record this binding name for use at the top-level.
+    // Record this binding name for use at the top-level.  This is done while
+    // traversing, so that the order of the bindings is deterministic.
     binding_names_.push_back(mangled_name);
     return true;
 }
 
+void chimera::CompiledConfiguration::RenderQueued()
+{
+    if (render_queue_.empty())
+        return;
+
+    // Each task renders a binding, records the filename to be listed, and
+    // returns whether it succeeded.  Files that are up to date are listed
+    // without being rendered.
+    std::vector<std::function<bool()>> tasks;
+    std::vector<std::string> filenames(render_queue_.size());
+    std::vector<std::string> errors(render_queue_.size());
+    std::vector<std::string> sharded_contents;
+    if (parent_.GetShards() == 0)
+    {
+        for (std::size_t i = 0; i < render_queue_.size(); ++i)
+        {
+            const QueuedBinding &binding = render_queue_[i];
+            if (!binding.fingerprint.empty())
+                currentFingerprints_[binding.filename] = binding.fingerprint;
+
+            if (parent_.IsUpToDate(binding.path, binding.fingerprint))
+            {
+                ++chimera::util::OutputStats::unchanged;
+                filenames[i] = binding.filename;
+                continue;
+            }
+
+            tasks.emplace_back([this, &filenames, &errors, i]() {
+                render_queue_[i].render(errors[i]);
+                if (!errors[i].empty())
+                    return false;
+
+                filenames[i] = render_queue_[i].filename;
+                return true;
+            });
+        }
+    }
+    else
+    {
+        // The shards depend on the bindings of every translation unit, which
+        // are not known yet, so every binding is rendered while its AST is
+        // available, and its content is kept until the shards are written.
+        sharded_contents.resize(render_queue_.size());
+        for (std::size_t i = 0; i < render_queue_.size(); ++i)
+        {
+            tasks.emplace_back([this, &sharded_contents, &errors, i]() {
+                sharded_contents[i] = render_queue_[i].render(errors[i]);
+                return errors[i].empty();
+            });
+        }
+    }
+
+    // Each thread repeatedly takes the next task.  The calling thread also
+    // runs tasks, and the others are only started if they are not used by
+    // other translation units, so that the configured number of jobs is
+    // never exceeded.  A task that fails does not stop the others, and its
+    // error is only reported once every thread has finished.
+    std::atomic<std::size_t> next(0);
+    std::atomic<bool> failed(false);
+    const auto run_tasks = [&tasks, &next, &failed]() {
+        for (std::size_t i = next++; i < tasks.size(); i = next++)
+            if (!tasks[i]())
+                failed = true;
+    };
+
+    const unsigned extra_threads = parent_.ReserveThreads(
+        static_cast<unsigned>(std::min<std::size_t>(
+            parent_.GetJobs(), std::max<std::size_t>(tasks.size(), 1)))
+        - 1);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < extra_threads; ++i)
+        threads.emplace_back(run_tasks);
+    run_tasks();
+    for (auto &thread : threads)
+        thread.join();
+    parent_.ReleaseThreads(extra_threads);
+
+    // This may run on any of the threads that parse the sources, so the
+    // errors are reported by Configuration::RenderModule() instead.
+    if (failed)
+    {
+        std::lock_guard<std::mutex> lock(parent_.outputErrorsMutex_);
+        for (const auto &error : errors)
+            if (!error.empty())
+                parent_.outputErrors_.push_back(error);
+    }
+
+    if (!sharded_contents.empty())
+    {
+        std::lock_guard<std::mutex> lock(parent_.moduleMutex_);
+        for (std::size_t i = 0; i < render_queue_.size(); ++i)
+            parent_.shardedBindings_[render_queue_[i].shard_index].content
+                = std::move(sharded_contents[i]);
+    }
+    render_queue_.clear();
+
+    for (const auto &filename : filenames)
+        if (!filename.empty())
+            filenames_.push_back(filename);
+}
+
 bool chimera::CompiledConfiguration::Render(
     const std::shared_ptr<chimera::mstch::CXXRecord> context)
 {
-    return Render(bindingDefinition_.class_cpp, "class", context);
+    return Render(classTemplate_, "class", context, context->decl());
 }
 
 bool chimera::CompiledConfiguration::Render(
     const std::shared_ptr<chimera::mstch::Enum> context)
 {
-    return Render(bindingDefinition_.enum_cpp, "enum", context);
+    return Render(enumTemplate_, "enum", context, context->decl());
 }
 
 bool chimera::CompiledConfiguration::Render(
     const std::shared_ptr<chimera::mstch::Function> context)
 {
-    return Render(bindingDefinition_.function_cpp, "function", context);
+    return Render(functionTemplate_, "function", context, context->decl());
 }
 
 bool chimera::CompiledConfiguration::Render(
     const std::shared_ptr<chimera::mstch::Variable> context)
 {
-    return Render(bindingDefinition_.variable_cpp, "variable", context);
+    return Render(variableTemplate_, "variable", context, context->decl());
 }
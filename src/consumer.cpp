@@ -6,18 +6,31 @@
 
 using namespace clang;
 
-chimera::Consumer::Consumer(CompilerInstance *ci) : ci_(ci)
+chimera::Consumer::Consumer(CompilerInstance *ci, unsigned index)
+  : ci_(ci)
+  , index_(index)
 {
     // Do nothing.
 }
 
 void chimera::Consumer::HandleTranslationUnit(ASTContext &context)
 {
-    // Use the current translation unit to resolve the YAML configuration.
+    // Wait for the translation units of the previous sources to be
+    // traversed, since each binding is generated by the first translation
+    // unit that contains it.
     chimera::Configuration &config = chimera::Configuration::GetInstance();
-    chimera::Visitor visitor(ci_, config.Process(ci_));
+    if (!config.BeginTraversal(index_))
+        return;
+
+    // Use the current translation unit to resolve the YAML configuration.
+    chimera::Visitor visitor(ci_, config.Process(ci_, index_));
 
     // We can use ASTContext to get the TranslationUnitDecl, which is
     // a single Decl that collectively represents the entire source file.
     visitor.TraverseDecl(context.getTranslationUnitDecl());
+    config.EndTraversal(index_);
+
+    // Render the bindings that were generated during the traversal, while
+    // the next translation unit is traversed.
+    visitor.RenderBindings();
 }
@@ -0,0 +1,202 @@
+#include "chimera/eligibility.h"
+#include "chimera/util.h"
+
+#include <iostream>
+#include <sstream>
+#include <clang/Sema/Sema.h>
+
+using namespace clang;
+
+namespace
+{
+
+/**
+ * Looks up a key in one of the maps of the analysis, computing and inserting
+ * the value on a miss.
+ *
+ * The value is computed without holding the lock, since computing it may
+ * look up other values of the analysis.
+ */
+template <typename Map, typename Key, typename Compute>
+typename Map::mapped_type lookup(std::mutex &mutex, Map &map, const Key &key,
+                                 Compute compute)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = map.find(key);
+        if (it != map.end())
+            return it->second;
+    }
+
+    auto value = compute();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    map.insert(std::make_pair(key, value));
+    return value;
+}
+
+/**
+ * Describes a parameter for a warning message.
+ */
+std::string describeParameter(const ParmVarDecl *param_decl, unsigned iparam)
+{
+    std::stringstream ss;
+    if (param_decl->getNameAsString().empty())
+        ss << "the parameter at index " << iparam;
+    else
+        ss << "parameter '" << param_decl->getNameAsString() << "'";
+    return ss.str();
+}
+
+bool hasNonPublicType(QualType param_type)
+{
+    if (param_type->isReferenceType())
+        param_type = param_type.getNonReferenceType();
+
+    if (auto record_type = dyn_cast<RecordType>(param_type))
+    {
+        const CXXRecordDecl *cxx_record_decl
+            = cast<CXXRecordDecl>(record_type->getDecl());
+        return cxx_record_decl->getAccess() != AS_public;
+    }
+    return false;
+}
+
+} // namespace
+
+chimera::EligibilityAnalysis::EligibilityAnalysis(CompilerInstance *ci)
+  : ci_(ci)
+{
+    // Do nothing.
+}
+
+chimera::Verdict chimera::EligibilityAnalysis::CheckParameters(
+    const FunctionDecl *decl)
+{
+    return lookup(mutex_, parameters_, decl->getCanonicalDecl(),
+                  [this, decl]() { return ComputeParameters(decl); });
+}
+
+chimera::Verdict chimera::EligibilityAnalysis::CheckReturnType(
+    const NamedDecl *decl, QualType return_type)
+{
+    const auto key = std::make_pair(static_cast<const Decl *>(decl),
+                                    return_type.getAsOpaquePtr());
+    return lookup(mutex_, returnTypes_, key, [&]() {
+        return ComputeReturnType(decl, return_type);
+    });
+}
+
+bool chimera::EligibilityAnalysis::IsCopyable(QualType type)
+{
+    return lookup(mutex_, copyable_, type.getCanonicalType(), [&]() {
+        return chimera::util::isCopyable(ci_->getASTContext(), type);
+    });
+}
+
+bool chimera::EligibilityAnalysis::ContainsIncompleteType(QualType type)
+{
+    // This is keyed by the exact type rather than by its canonical type,
+    // since a typedef of a pointer to an incomplete type is not incomplete,
+    // while the pointer itself is.
+    return lookup(mutex_, incomplete_, type, [&]() {
+        return chimera::util::containsIncompleteType(ci_->getSema(), type);
+    });
+}
+
+chimera::Verdict chimera::EligibilityAnalysis::ComputeParameters(
+    const FunctionDecl *decl)
+{
+    Verdict verdict;
+    const unsigned int num_params = decl->getNumParams();
+
+    // Describes the parameter that makes the function ineligible.
+    auto reject = [&](Verdict::Reason reason, unsigned int iparam,
+                      const char *problem) {
+        const ParmVarDecl *const param_decl = decl->getParamDecl(iparam);
+        verdict.reason = reason;
+        verdict.message = describeParameter(param_decl, iparam) + problem
+                          + " '"
+                          + chimera::util::getFullyQualifiedTypeName(
+                                ci_->getASTContext(), param_decl->getType())
+                          + "'";
+    };
+
+    // Each property is checked for all parameters before the next one, so
+    // that a function with several problems is always rejected for the
+    // property that is checked first.
+    if (isa<CXXMethodDecl>(decl))
+    {
+        for (unsigned int iparam = 0; iparam < num_params; ++iparam)
+        {
+            if (hasNonPublicType(decl->getParamDecl(iparam)->getType()))
+            {
+                reject(Verdict::Reason::NonPublicParameter, iparam,
+                       " has the non-public type");
+                return verdict;
+            }
+        }
+
+        for (unsigned int iparam = 0; iparam < num_params; ++iparam)
+        {
+            if (decl->getParamDecl(iparam)->getType()->isRValueReferenceType())
+            {
+                reject(Verdict::Reason::RValueReference, iparam,
+                       " is an rvalue reference of type");
+                break;
+            }
+        }
+    }
+
+    for (unsigned int iparam = 0; verdict.eligible() && iparam < num_params;
+         ++iparam)
+    {
+        const ParmVarDecl *const param_decl = decl->getParamDecl(iparam);
+        if (ContainsIncompleteType(param_decl->getOriginalType()))
+            reject(Verdict::Reason::IncompleteType, iparam,
+                   " has an incomplete type");
+    }
+
+    for (unsigned int iparam = 0; verdict.eligible() && iparam < num_params;
+         ++iparam)
+    {
+        const QualType param_type = decl->getParamDecl(iparam)->getType();
+        if (!param_type->isReferenceType() && !param_type->isPointerType()
+            && !IsCopyable(param_type))
+            reject(Verdict::Reason::NonCopyableType, iparam,
+                   " has a non-copyable type");
+    }
+
+    // Methods with non-public parameter types are meant to be hidden, such
+    // as constructors that are only called by friends, so they are skipped
+    // without a warning.
+    if (!verdict.eligible()
+        && verdict.reason != Verdict::Reason::NonPublicParameter)
+        std::cerr << "Warning: Skipped function '"
+                  << decl->getQualifiedNameAsString() << "' because "
+                  << verdict.message << ".\n";
+    return verdict;
+}
+
+chimera::Verdict chimera::EligibilityAnalysis::ComputeReturnType(
+    const NamedDecl *decl, QualType return_type)
+{
+    Verdict verdict;
+    const char *kind = nullptr;
+    if (return_type.getTypePtr()->isReferenceType())
+        kind = "reference";
+    else if (return_type.getTypePtr()->isPointerType())
+        kind = "pointer";
+    else
+        return verdict;
+
+    verdict.reason = Verdict::Reason::NeedsReturnValuePolicy;
+    verdict.message = std::string("it returns the ") + kind + " type '"
+                      + chimera::util::getFullyQualifiedTypeName(
+                            ci_->getASTContext(), return_type)
+                      + "' and no 'return_value_policy' was specified";
+
+    std::cerr << "Warning: Skipped method '" << decl->getQualifiedNameAsString()
+              << "' because " << verdict.message << ".\n";
+    return verdict;
+}
@@ -1,21 +1,283 @@
 #include "chimera/frontend_action.h"
+#include "chimera/configuration.h"
 #include "chimera/consumer.h"
+#include "chimera/util.h"
 
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Frontend/FrontendActions.h>
+#include <clang/Lex/Lexer.h>
+#include <clang/Lex/PreprocessorOptions.h>
 #include <clang/Parse/Parser.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
 
 using namespace clang;
 
+namespace
+{
+
+/**
+ * Generates the precompiled header of the preamble of a source, and records
+ * the content hash of every other file that was loaded to generate it.
+ */
+class PrecompilePreambleAction : public GeneratePCHAction
+{
+public:
+    const std::vector<std::pair<std::string, std::string>> &GetLoadedFiles()
+        const
+    {
+        return loadedFiles_;
+    }
+
+protected:
+    void EndSourceFileAction() override
+    {
+        const SourceManager &source_manager
+            = getCompilerInstance().getSourceManager();
+        const FileEntry *main_file
+            = source_manager.getFileEntryForID(source_manager.getMainFileID());
+        for (auto it = source_manager.fileinfo_begin();
+             it != source_manager.fileinfo_end(); ++it)
+        {
+            if (it->first == main_file)
+                continue;
+
+            // Hash the content that was parsed if it is still loaded.
+            const std::string filename(it->first->getName());
+            if (const llvm::MemoryBuffer *buffer = it->second->getRawBuffer())
+            {
+                loadedFiles_.emplace_back(
+                    chimera::util::hashContent(buffer->getBuffer()), filename);
+                continue;
+            }
+            auto buffer = llvm::MemoryBuffer::getFile(filename);
+            if (buffer)
+                loadedFiles_.emplace_back(
+                    chimera::util::hashContent((*buffer)->getBuffer()),
+                    filename);
+        }
+        GeneratePCHAction::EndSourceFileAction();
+    }
+
+private:
+    std::vector<std::pair<std::string, std::string>> loadedFiles_;
+};
+
+/**
+ * Reads the files that were loaded to generate a cached preamble, and returns
+ * whether none of them changed since then.
+ */
+bool readLoadedFiles(const std::string &files_path,
+                     std::vector<std::string> &filenames)
+{
+    std::ifstream files(files_path);
+    if (!files)
+        return false;
+
+    std::string hash;
+    std::string filename;
+    while (files >> hash && std::getline(files >> std::ws, filename))
+    {
+        auto buffer = llvm::MemoryBuffer::getFile(filename);
+        if (!buffer
+            || chimera::util::hashContent((*buffer)->getBuffer()) != hash)
+            return false;
+        filenames.push_back(filename);
+    }
+    return files.eof();
+}
+
+/**
+ * Generates the precompiled header of the preamble of the main file with the
+ * same options as the compiler instance, and writes the files that it loaded.
+ */
+bool precompilePreamble(CompilerInstance &CI, const std::string &main_file,
+                        llvm::StringRef preamble, const std::string &pch_path,
+                        const std::string &files_path,
+                        std::vector<std::string> &filenames)
+{
+#if LLVM_VERSION_AT_LEAST(6, 0, 0)
+    auto invocation = std::make_shared<CompilerInvocation>(CI.getInvocation());
+#else
+    auto invocation = new CompilerInvocation(CI.getInvocation());
+#endif
+
+    // Parse only the preamble of the main file.  This is how clang generates
+    // preambles for code completion.
+    FrontendOptions &frontend_opts = invocation->getFrontendOpts();
+    frontend_opts.ProgramAction = frontend::GeneratePCH;
+    frontend_opts.OutputFile = pch_path;
+    PreprocessorOptions &pp_opts = invocation->getPreprocessorOpts();
+    pp_opts.clearRemappedFiles();
+    pp_opts.RetainRemappedFileBuffers = false;
+    pp_opts.addRemappedFile(
+        main_file,
+        llvm::MemoryBuffer::getMemBufferCopy(preamble, main_file).release());
+    pp_opts.PrecompiledPreambleBytes = std::make_pair(0u, false);
+#if LLVM_VERSION_AT_LEAST(6, 0, 0)
+    // Record the conditionals that are still open at the end of the preamble,
+    // such as an include guard.
+    pp_opts.GeneratePreamble = true;
+#endif
+
+    CompilerInstance compiler;
+    compiler.setInvocation(invocation);
+    compiler.createDiagnostics(&CI.getDiagnosticClient(),
+                               /* ShouldOwnClient = */ false);
+    compiler.getDiagnostics().setIgnoreAllWarnings(true);
+
+    PrecompilePreambleAction action;
+    if (!compiler.ExecuteAction(action)
+        || compiler.getDiagnostics().hasErrorOccurred())
+    {
+        llvm::sys::fs::remove(pch_path);
+        return false;
+    }
+
+    // The list of files is written last, since it marks the cache entry as
+    // complete.
+    const std::string temp_path = files_path + ".tmp";
+    {
+        std::ofstream files(temp_path);
+        for (const auto &file : action.GetLoadedFiles())
+        {
+            files << file.first << " " << file.second << "\n";
+            filenames.push_back(file.second);
+        }
+        if (!files)
+            return false;
+    }
+    return !llvm::sys::fs::rename(temp_path, files_path);
+}
+
+/**
+ * Sets up the compiler instance to parse the preamble of the main file from a
+ * precompiled header in the cache, which is generated if it is missing or one
+ * of the files that it loaded changed.
+ *
+ * The preamble is the sequence of includes and other directives at the start
+ * of the main file.  Cache entries are named by a hash of the preamble and of
+ * the options that affect how it is parsed.  If anything goes wrong, the main
+ * file is parsed from scratch.
+ */
+void usePrecompiledPreamble(CompilerInstance &CI, const std::string &cache_path)
+{
+    // A translation unit can only include one precompiled header.
+    PreprocessorOptions &pp_opts = CI.getPreprocessorOpts();
+    const FrontendOptions &frontend_opts = CI.getFrontendOpts();
+    if (!pp_opts.ImplicitPCHInclude.empty() || frontend_opts.Inputs.size() != 1)
+        return;
+
+    const std::string main_file = frontend_opts.Inputs[0].getFile();
+    auto buffer = llvm::MemoryBuffer::getFile(main_file);
+    if (!buffer)
+        return;
+
+    // Older versions of clang end the preamble before a conditional that is
+    // still open, such as an include guard.
+    const LangOptions &lang_opts = *CI.getInvocation().getLangOpts();
+#if LLVM_VERSION_AT_LEAST(6, 0, 0)
+    const PreambleBounds bounds
+        = Lexer::ComputePreamble((*buffer)->getBuffer(), lang_opts);
+    const std::pair<unsigned, bool> preamble_bytes(
+        bounds.Size, bounds.PreambleEndsAtStartOfLine);
+#else
+    const std::pair<unsigned, bool> preamble_bytes
+        = Lexer::ComputePreamble((*buffer)->getBuffer(), lang_opts);
+#endif
+    if (preamble_bytes.first == 0)
+        return;
+    const llvm::StringRef preamble
+        = (*buffer)->getBuffer().substr(0, preamble_bytes.first);
+
+    // The module hash covers the version of clang, the language and target
+    // options and the macros, but not the include paths.
+    std::stringstream key;
+    key << CI.getInvocation().getModuleHash() << "\n" << main_file << "\n";
+    for (const auto &entry : CI.getHeaderSearchOpts().UserEntries)
+        key << entry.Path << "\n";
+    key << preamble;
+    const std::string entry_path
+        = cache_path + "/" + chimera::util::hashContent(key.str());
+    const std::string pch_path = entry_path + ".pch";
+    const std::string files_path = entry_path + ".files";
+
+    std::vector<std::string> filenames;
+    if (!llvm::sys::fs::exists(pch_path)
+        || !readLoadedFiles(files_path, filenames))
+    {
+        filenames.clear();
+        if (llvm::sys::fs::create_directories(cache_path)
+            || !precompilePreamble(CI, main_file, preamble, pch_path,
+                                   files_path, filenames))
+        {
+            std::cerr << "Warning: Failed to precompile the preamble of '"
+                      << main_file << "'." << std::endl;
+            return;
+        }
+        ++chimera::PreambleCacheStats::generated;
+    }
+    else
+    {
+        ++chimera::PreambleCacheStats::reused;
+    }
+
+    // The loaded files were validated by their content above, so clang must
+    // not reject them because of their modification times.
+    pp_opts.ImplicitPCHInclude = pch_path;
+    pp_opts.PrecompiledPreambleBytes = preamble_bytes;
+    pp_opts.DisablePCHValidation = true;
+
+    // These files are not loaded by the source manager of the instance.
+    for (const std::string &filename : filenames)
+        chimera::Configuration::GetInstance().AddDependency(filename);
+}
+
+} // namespace
+
+std::atomic<unsigned long> chimera::PreambleCacheStats::reused(0);
+std::atomic<unsigned long> chimera::PreambleCacheStats::generated(0);
+
+chimera::FrontendAction::FrontendAction(unsigned index) : index_(index)
+{
+    // Do nothing.
+}
+
+bool chimera::FrontendAction::BeginInvocation(CompilerInstance &CI)
+{
+    const std::string &cache_path
+        = chimera::Configuration::GetInstance().GetPreambleCachePath();
+    if (!cache_path.empty())
+        usePrecompiledPreamble(CI, cache_path);
+    return true;
+}
+
 std::unique_ptr<clang::ASTConsumer> chimera::FrontendAction::CreateASTConsumer(
     CompilerInstance &CI, StringRef /*file*/)
 {
-    // For some unknown reason, this is called twice, which should be once.
-    // As a workaround, we check if this called first, otherwise return nullptr.
-    static bool is_first = true;
-    if (!is_first)
-        return nullptr;
+    // A source may have several compile commands, in which case this is
+    // called for each of them, but only the first one is traversed (see
+    // Configuration::BeginTraversal()).
+    CI.getPreprocessor().getDiagnostics().setIgnoreAllWarnings(true);
+    return std::unique_ptr<chimera::Consumer>(
+        new chimera::Consumer(&CI, index_));
+}
 
-    is_first = false;
+chimera::FrontendActionFactory::FrontendActionFactory(unsigned index)
+  : index_(index)
+{
+    // Do nothing.
+}
 
-    CI.getPreprocessor().getDiagnostics().setIgnoreAllWarnings(true);
-    return std::unique_ptr<chimera::Consumer>(new chimera::Consumer(&CI));
+clang::FrontendAction *chimera::FrontendActionFactory::create()
+{
+    return new chimera::FrontendAction(index_);
 }
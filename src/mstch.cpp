@@ -212,33 +212,63 @@ namespace mstch
     return generateScope(config, nns);
 }
 
+/**
+ * Returns a scope array that is shared by every declaration whose scope only
+ * depends on `decl_context`, generating it on first use.
+ *
+ * `name` identifies the kind of scope array and how it is derived from the
+ * context, since e.g. the scope of a class within a namespace differs from
+ * the scope of the namespace itself.
+ */
+template <typename Generate>
+::mstch::node sharedScope(const ::chimera::CompiledConfiguration &config,
+                          const std::string &name,
+                          const clang::DeclContext *decl_context,
+                          Generate generate)
+{
+    const Decl *key
+        = decl_context
+              ? Decl::castFromDeclContext(decl_context)->getCanonicalDecl()
+              : nullptr;
+    return config.GetSharedNode(name, key, generate);
+}
+
 CXXRecord::CXXRecord(const ::chimera::CompiledConfiguration &config,
                      const CXXRecordDecl *decl,
                      const std::set<const CXXRecordDecl *> *available_decls)
   : ClangWrapper(config, decl), available_decls_(available_decls)
 {
-    register_methods(
-        this,
-        {
-            {"bases", &CXXRecord::bases},
-            {"bases?", &CXXRecord::isNonFalse<CXXRecord, &CXXRecord::bases>},
-            {"type", &CXXRecord::type},
-            {"is_copyable", &CXXRecord::isCopyable},
-            {"constructors", &CXXRecord::constructors},
-            {"constructors?",
-             &CXXRecord::isNonFalse<CXXRecord, &CXXRecord::constructors>},
-            {"methods", &CXXRecord::methods},
-            {"methods?",
-             &CXXRecord::isNonFalse<CXXRecord, &CXXRecord::methods>},
-            {"fields", &CXXRecord::fields},
-            {"fields?", &CXXRecord::isNonFalse<CXXRecord, &CXXRecord::fields>},
-            {"static_fields", &CXXRecord::staticFields},
-            {"static_fields?",
-             &CXXRecord::isNonFalse<CXXRecord, &CXXRecord::staticFields>},
-            {"static_methods", &CXXRecord::staticMethods},
-            {"static_methods?",
-             &CXXRecord::isNonFalse<CXXRecord, &CXXRecord::methods>},
+    set_method_table(methodTable());
+}
+
+const CXXRecord::MethodTable &CXXRecord::methodTable()
+{
+    static const MethodTable table = [] {
+        MethodTable table(ClangWrapper::methodTable());
+        table.add("bases", &CXXRecord::bases)
+            .add("bases?", predicate("bases"))
+            .add("type", &CXXRecord::type)
+            .add("is_copyable", &CXXRecord::isCopyable)
+            .add("constructors", &CXXRecord::constructors)
+            .add("constructors?", predicate("constructors"))
+            .add("methods", &CXXRecord::methods)
+            .add("methods?", predicate("methods"))
+            .add("fields", &CXXRecord::fields)
+            .add("fields?", predicate("fields"))
+            .add("static_fields", &CXXRecord::staticFields)
+            .add("static_fields?", predicate("static_fields"))
+            .add("static_methods", &CXXRecord::staticMethods)
+            .add("static_methods?", predicate("methods"));
+
+        // Each of these lists re-checks every member of the class, so only
+        // compute them once per declaration.
+        table.memoize({
+            "bases", "type", "is_copyable", "constructors", "methods",
+            "fields", "static_fields", "static_methods",
         });
+        return table;
+    }();
+    return table;
 }
 
 ::mstch::node CXXRecord::bases()
@@ -247,17 +277,17 @@ CXXRecord::CXXRecord(const ::chimera::CompiledConfiguration &config,
         return chimera::util::wrapYAMLNode(node);
 
     // Get all bases of this class.
-    std::set<const CXXRecordDecl *> base_decls
+    std::vector<const CXXRecordDecl *> base_decls
         = chimera::util::getBaseClassDecls(decl_);
 
     // If a list of available decls is provided, only use available base
     // classes.
     if (available_decls_)
     {
-        std::set<const CXXRecordDecl *> available_base_decls;
+        std::vector<const CXXRecordDecl *> available_base_decls;
         std::copy_if(
             base_decls.begin(), base_decls.end(),
-            std::inserter(available_base_decls, available_base_decls.end()),
+            std::back_inserter(available_base_decls),
             [this](const CXXRecordDecl *base_decl) {
                 return (available_decls_->find(base_decl->getCanonicalDecl())
                         != available_decls_->end());
@@ -287,11 +317,15 @@ CXXRecord::CXXRecord(const ::chimera::CompiledConfiguration &config,
 
 ::mstch::node CXXRecord::scope()
 {
-    const NestedNameSpecifier *nns
-        = cling::utils::TypeName::CreateNestedNameSpecifier(
-            config_.GetContext(), decl_->getCanonicalDecl(), true);
+    const DeclContext *decl_context
+        = decl_->getCanonicalDecl()->getDeclContext();
+    return sharedScope(config_, "tag_scope", decl_context, [this]() {
+        const NestedNameSpecifier *nns
+            = cling::utils::TypeName::CreateNestedNameSpecifier(
+                config_.GetContext(), decl_->getCanonicalDecl(), true);
 
-    return generateScope(config_, nns->getPrefix());
+        return generateScope(config_, nns->getPrefix());
+    });
 }
 
 ::mstch::node CXXRecord::type()
@@ -305,20 +339,28 @@ CXXRecord::CXXRecord(const ::chimera::CompiledConfiguration &config,
 
 ::mstch::node CXXRecord::namespaceScope()
 {
-    const NestedNameSpecifier *nns
-        = cling::utils::TypeName::CreateNestedNameSpecifier(
-            config_.GetContext(), decl_->getCanonicalDecl(), true);
+    const DeclContext *decl_context
+        = decl_->getCanonicalDecl()->getDeclContext();
+    return sharedScope(config_, "tag_namespace_scope", decl_context, [this]() {
+        const NestedNameSpecifier *nns
+            = cling::utils::TypeName::CreateNestedNameSpecifier(
+                config_.GetContext(), decl_->getCanonicalDecl(), true);
 
-    return generateNamespaceScope(config_, nns->getPrefix());
+        return generateNamespaceScope(config_, nns->getPrefix());
+    });
 }
 
 ::mstch::node CXXRecord::classScope()
 {
-    const NestedNameSpecifier *nns
-        = cling::utils::TypeName::CreateNestedNameSpecifier(
-            config_.GetContext(), decl_->getCanonicalDecl(), true);
+    const DeclContext *decl_context
+        = decl_->getCanonicalDecl()->getDeclContext();
+    return sharedScope(config_, "tag_class_scope", decl_context, [this]() {
+        const NestedNameSpecifier *nns
+            = cling::utils::TypeName::CreateNestedNameSpecifier(
+                config_.GetContext(), decl_->getCanonicalDecl(), true);
 
-    return generateClassScope(config_, nns->getPrefix());
+        return generateClassScope(config_, nns->getPrefix());
+    });
 }
 
 ::mstch::node CXXRecord::isCopyable()
@@ -366,26 +408,14 @@ CXXRecord::CXXRecord(const ::chimera::CompiledConfiguration &config,
             continue;
         if (method_decl->getAccess() != AS_public)
             continue; // skip protected and private members
-        if (chimera::util::hasNonPublicParam(method_decl))
-            continue;
         if (method_decl->isDeleted())
             continue;
         if (!isa<CXXConstructorDecl>(method_decl))
             continue;
-        if (chimera::util::containsRValueReference(method_decl))
-            continue;
-
-        // Skip functions that have incomplete argument types. Boost.Python
-        // requires RTTI information about all arguments, including references
-        // and pointers.
-        if (chimera::util::containsIncompleteType(
-                config_.GetCompilerInstance()->getSema(), method_decl))
-            continue;
 
-        // Skip functions that have non-copyable argument types.
-        // Using these functions requires std::move()-ing their arguments, which
-        // we generally cannot do.
-        if (chimera::util::containsNonCopyableType(method_decl))
+        // Skip functions whose parameters cannot be bound, e.g. because they
+        // have incomplete or non-copyable types (see EligibilityAnalysis).
+        if (!config_.GetEligibility().CheckParameters(method_decl).eligible())
             continue;
 
         const CXXConstructorDecl *constructor_decl
@@ -421,8 +451,6 @@ CXXRecord::CXXRecord(const ::chimera::CompiledConfiguration &config,
             continue;
         if (method_decl->getAccess() != AS_public)
             continue; // skip protected and private members
-        if (chimera::util::hasNonPublicParam(method_decl))
-            continue;
         if (isa<CXXConversionDecl>(method_decl))
             continue;
         if (isa<CXXDestructorDecl>(method_decl))
@@ -435,31 +463,22 @@ CXXRecord::CXXRecord(const ::chimera::CompiledConfiguration &config,
             continue;
         if (method_decl->getDescribedFunctionTemplate())
             continue;
-        if (chimera::util::containsRValueReference(method_decl))
-            continue;
 
-        // Skip functions that have incomplete argument types. Boost.Python
-        // requires RTTI information about all arguments, including references
-        // and pointers.
-        if (chimera::util::containsIncompleteType(
-                config_.GetCompilerInstance()->getSema(), method_decl))
-            continue;
-
-        // Skip functions that have non-copyable argument types.
-        // Using these functions requires std::move()-ing their arguments, which
-        // we generally cannot do.
-        if (chimera::util::containsNonCopyableType(method_decl))
+        // Skip functions whose parameters cannot be bound, e.g. because they
+        // have incomplete or non-copyable types (see EligibilityAnalysis).
+        if (!config_.GetEligibility().CheckParameters(method_decl).eligible())
             continue;
 
         // Generate the method wrapper (but don't add it just yet).
         auto method = std::make_shared<Method>(config_, method_decl, decl_);
 
         // Check if a return_value_policy can be generated for this function.
-        if (::mstch::render("{{return_value_policy}}", method).empty()
-            && chimera::util::needsReturnValuePolicy(
-                   method_decl, method_decl->getReturnType()))
+        if (::mstch::is_empty(method->at("return_value_policy"))
+            && !config_.GetEligibility()
+                    .CheckReturnType(method_decl, method_decl->getReturnType())
+                    .eligible())
         {
-            // `needsReturnValuePolicy()` already prints an error message,
+            // `CheckReturnType()` already prints an error message,
             // so just continue to the next method if we got here.
             continue;
         }
@@ -481,7 +500,9 @@ CXXRecord::CXXRecord(const ::chimera::CompiledConfiguration &config,
 
 ::mstch::node CXXRecord::staticMethods()
 {
-    ::mstch::array method_templates = boost::get<::mstch::array>(methods());
+    // Reuse the (memoized) list of methods rather than recomputing it.
+    const ::mstch::array &method_templates
+        = boost::get<::mstch::array>(at("methods"));
     std::map<std::string, bool> is_static_method;
 
     // Iterate through all methods searching for static ones.
@@ -539,8 +560,7 @@ CXXRecord::CXXRecord(const ::chimera::CompiledConfiguration &config,
         if (field_decl->getAccess() != AS_public)
             continue; // skip protected and private fields
 
-        if (!chimera::util::isCopyable(config_.GetContext(),
-                                       field_decl->getType()))
+        if (!config_.GetEligibility().IsCopyable(field_decl->getType()))
             continue;
 
         field_vector.push_back(
@@ -579,8 +599,10 @@ CXXRecord::CXXRecord(const ::chimera::CompiledConfiguration &config,
             continue;
 
         // Check if a return_value_policy can be generated for this function.
-        if (chimera::util::needsReturnValuePolicy(static_field_decl,
-                                                  static_field_decl->getType()))
+        if (!config_.GetEligibility()
+                 .CheckReturnType(static_field_decl,
+                                  static_field_decl->getType())
+                 .eligible())
             continue;
 
         static_field_vector.push_back(
@@ -601,10 +623,18 @@ CXXRecord::CXXRecord(const ::chimera::CompiledConfiguration &config,
 Enum::Enum(const ::chimera::CompiledConfiguration &config, const EnumDecl *decl)
   : ClangWrapper(config, decl)
 {
-    register_methods(this, {
-                               {"type", &Enum::type},
-                               {"values", &Enum::values},
-                           });
+    set_method_table(methodTable());
+}
+
+const Enum::MethodTable &Enum::methodTable()
+{
+    static const MethodTable table = [] {
+        MethodTable table(ClangWrapper::methodTable());
+        table.add("type", &Enum::type).add("values", &Enum::values);
+        table.memoize({"type", "values"});
+        return table;
+    }();
+    return table;
 }
 
 ::mstch::node Enum::qualifiedName()
@@ -621,29 +651,41 @@ Enum::Enum(const ::chimera::CompiledConfiguration &config, const EnumDecl *decl)
 
 ::mstch::node Enum::namespaceScope()
 {
-    const NestedNameSpecifier *nns
-        = cling::utils::TypeName::CreateNestedNameSpecifier(
-            config_.GetContext(), decl_->getCanonicalDecl(), true);
+    const DeclContext *decl_context
+        = decl_->getCanonicalDecl()->getDeclContext();
+    return sharedScope(config_, "tag_namespace_scope", decl_context, [this]() {
+        const NestedNameSpecifier *nns
+            = cling::utils::TypeName::CreateNestedNameSpecifier(
+                config_.GetContext(), decl_->getCanonicalDecl(), true);
 
-    return generateNamespaceScope(config_, nns->getPrefix());
+        return generateNamespaceScope(config_, nns->getPrefix());
+    });
 }
 
 ::mstch::node Enum::classScope()
 {
-    const NestedNameSpecifier *nns
-        = cling::utils::TypeName::CreateNestedNameSpecifier(
-            config_.GetContext(), decl_->getCanonicalDecl(), true);
+    const DeclContext *decl_context
+        = decl_->getCanonicalDecl()->getDeclContext();
+    return sharedScope(config_, "tag_class_scope", decl_context, [this]() {
+        const NestedNameSpecifier *nns
+            = cling::utils::TypeName::CreateNestedNameSpecifier(
+                config_.GetContext(), decl_->getCanonicalDecl(), true);
 
-    return generateClassScope(config_, nns->getPrefix());
+        return generateClassScope(config_, nns->getPrefix());
+    });
 }
 
 ::mstch::node Enum::scope()
 {
-    const NestedNameSpecifier *nns
-        = cling::utils::TypeName::CreateNestedNameSpecifier(
-            config_.GetContext(), decl_->getCanonicalDecl(), true);
+    const DeclContext *decl_context
+        = decl_->getCanonicalDecl()->getDeclContext();
+    return sharedScope(config_, "tag_scope", decl_context, [this]() {
+        const NestedNameSpecifier *nns
+            = cling::utils::TypeName::CreateNestedNameSpecifier(
+                config_.GetContext(), decl_->getCanonicalDecl(), true);
 
-    return generateScope(config_, nns->getPrefix());
+        return generateScope(config_, nns->getPrefix());
+    });
 }
 
 ::mstch::node Enum::type()
@@ -696,8 +738,9 @@ EnumConstant::EnumConstant(const ::chimera::CompiledConfiguration &config,
     // In the special case of EnumConstants, rather than letting clang try to
     // fully resolve the qualified name, we can simply get it from appending
     // this value to the parent Enum's qualified name.
+    static const ::mstch::compiled_template type_template("{{type}}");
     auto enumeration = std::make_shared<Enum>(config_, enum_decl_);
-    return ::mstch::render("{{type}}", enumeration)
+    return ::mstch::render(type_template, enumeration)
            + "::" + decl_->getNameAsString();
 }
 
@@ -705,12 +748,20 @@ Field::Field(const ::chimera::CompiledConfiguration &config,
              const FieldDecl *decl, const CXXRecordDecl *class_decl)
   : ClangWrapper(config, decl), class_decl_(class_decl)
 {
-    register_methods(this,
-                     {
-                         {"is_assignable", &Field::isAssignable},
-                         {"is_copyable", &Field::isCopyable},
-                         {"return_value_policy", &Field::returnValuePolicy},
-                     });
+    set_method_table(methodTable());
+}
+
+const Field::MethodTable &Field::methodTable()
+{
+    static const MethodTable table = [] {
+        MethodTable table(ClangWrapper::methodTable());
+        table.add("is_assignable", &Field::isAssignable)
+            .add("is_copyable", &Field::isCopyable)
+            .add("return_value_policy", &Field::returnValuePolicy);
+        table.memoize({"return_value_policy"});
+        return table;
+    }();
+    return table;
 }
 
 ::mstch::node Field::isAssignable()
@@ -726,7 +777,7 @@ Field::Field(const ::chimera::CompiledConfiguration &config,
     if (const YAML::Node &node = decl_config_["is_copyable"])
         return node.as<std::string>();
 
-    return chimera::util::isCopyable(config_.GetContext(), decl_->getType());
+    return config_.GetEligibility().IsCopyable(decl_->getType());
 }
 
 ::mstch::node Field::returnValuePolicy()
@@ -764,26 +815,40 @@ Function::Function(const ::chimera::CompiledConfiguration &config,
   , class_decl_(class_decl)
   , argument_limit_(argument_limit)
 {
-    register_methods(
-        this,
-        {
-            {"type", &Function::type},
-            {"overloads", &Function::overloads},
-            {"params", &Function::params},
-            {"params?", &Function::isNonFalse<Function, &Function::params>},
-            {"return_type", &Function::returnType},
-            {"return_value_policy", &Function::returnValuePolicy},
-            {"is_void", &Function::isVoid},
-            {"uses_defaults", &Function::usesDefaults},
-            {"is_template", &Function::isTemplate},
-            {"call", &Function::call},
-            {"qualified_call", &Function::qualifiedCall},
+    set_method_table(methodTable());
+}
+
+const Function::MethodTable &Function::methodTable()
+{
+    static const MethodTable table = [] {
+        MethodTable table(ClangWrapper::methodTable());
+        table.add("type", &Function::type)
+            .add("overloads", &Function::overloads)
+            .add("params", &Function::params)
+            .add("params?", predicate("params"))
+            .add("return_type", &Function::returnType)
+            .add("return_value_policy", &Function::returnValuePolicy)
+            .add("is_void", &Function::isVoid)
+            .add("uses_defaults", &Function::usesDefaults)
+            .add("is_template", &Function::isTemplate)
+            .add("call", &Function::call)
+            .add("qualified_call", &Function::qualifiedCall);
+        table.memoize({
+            "type", "overloads", "params", "return_type",
+            "return_value_policy", "is_void", "call", "qualified_call",
         });
+        return table;
+    }();
+    return table;
 }
 
 ::mstch::node Function::scope()
 {
-    return generateScope(config_, decl_->getEnclosingNamespaceContext());
+    const DeclContext *decl_context = decl_->getEnclosingNamespaceContext();
+    return sharedScope(config_, "context_scope", decl_context,
+                       [this, decl_context]() {
+                           return generateScope(config_, decl_context);
+                       });
 }
 
 ::mstch::node Function::type()
@@ -821,7 +886,11 @@ Function::Function(const ::chimera::CompiledConfiguration &config,
 
     // Add this function to its own list of overloads.
     // It can be distinguished from other copies because `uses_defaults=false`.
-    overloads.push_back(shared_from_this());
+    //
+    // Since this list is memoized by the function itself, it holds a
+    // non-owning pointer to avoid a reference cycle.
+    overloads.push_back(
+        std::shared_ptr<Function>(std::shared_ptr<Function>(), this));
 
     return overloads;
 }
@@ -905,13 +974,20 @@ Function::Function(const ::chimera::CompiledConfiguration &config,
 
 ::mstch::node Function::namespaceScope()
 {
-    return generateNamespaceScope(config_,
-                                  decl_->getEnclosingNamespaceContext());
+    const DeclContext *decl_context = decl_->getEnclosingNamespaceContext();
+    return sharedScope(config_, "context_namespace_scope", decl_context,
+                       [this, decl_context]() {
+                           return generateNamespaceScope(config_, decl_context);
+                       });
 }
 
 ::mstch::node Function::classScope()
 {
-    return generateClassScope(config_, decl_->getEnclosingNamespaceContext());
+    const DeclContext *decl_context = decl_->getEnclosingNamespaceContext();
+    return sharedScope(config_, "context_class_scope", decl_context,
+                       [this, decl_context]() {
+                           return generateClassScope(config_, decl_context);
+                       });
 }
 
 ::mstch::node Function::usesDefaults()
@@ -966,10 +1042,18 @@ Method::Method(const ::chimera::CompiledConfiguration &config,
                const CXXMethodDecl *decl, const CXXRecordDecl *class_decl)
   : Function(config, decl, class_decl), method_decl_(decl)
 {
-    register_methods(this, {
-                               {"is_const", &Method::isConst},
-                               {"is_static", &Method::isStatic},
-                           });
+    set_method_table(methodTable());
+}
+
+const Method::MethodTable &Method::methodTable()
+{
+    static const MethodTable table = [] {
+        MethodTable table(Function::methodTable());
+        table.add("is_const", &Method::isConst)
+            .add("is_static", &Method::isStatic);
+        return table;
+    }();
+    return table;
 }
 
 ::mstch::node Method::isConst()
@@ -991,11 +1075,15 @@ Namespace::Namespace(const ::chimera::CompiledConfiguration &config,
 
 ::mstch::node Namespace::scope()
 {
-    const NestedNameSpecifier *nns
-        = cling::utils::TypeName::CreateNestedNameSpecifier(
-            config_.GetContext(), decl_->getCanonicalDecl());
+    // Inline namespaces are skipped when the scope of a namespace is created,
+    // so this is keyed by the namespace itself rather than by its context.
+    return sharedScope(config_, "namespace_scope", decl_, [this]() {
+        const NestedNameSpecifier *nns
+            = cling::utils::TypeName::CreateNestedNameSpecifier(
+                config_.GetContext(), decl_->getCanonicalDecl());
 
-    return generateScope(config_, nns->getPrefix());
+        return generateScope(config_, nns->getPrefix());
+    });
 }
 
 Parameter::Parameter(const ::chimera::CompiledConfiguration &config,
@@ -1007,10 +1095,18 @@ Parameter::Parameter(const ::chimera::CompiledConfiguration &config,
   , class_decl_(class_decl)
   , default_name_(default_name)
 {
-    register_methods(this, {
-                               {"name", &Parameter::name},
-                               {"type", &Parameter::type},
-                           });
+    set_method_table(methodTable());
+}
+
+const Parameter::MethodTable &Parameter::methodTable()
+{
+    static const MethodTable table = [] {
+        MethodTable table(ClangWrapper::methodTable());
+        table.add("type", &Parameter::type);
+        table.memoize({"type"});
+        return table;
+    }();
+    return table;
 }
 
 ::std::string Parameter::nameAsString()
@@ -1049,9 +1145,17 @@ Variable::Variable(const ::chimera::CompiledConfiguration &config,
                    const VarDecl *decl, const CXXRecordDecl *class_decl)
   : ClangWrapper(config, decl), class_decl_(class_decl)
 {
-    register_methods(this, {
-                               {"is_assignable", &Variable::isAssignable},
-                           });
+    set_method_table(methodTable());
+}
+
+const Variable::MethodTable &Variable::methodTable()
+{
+    static const MethodTable table = [] {
+        MethodTable table(ClangWrapper::methodTable());
+        table.add("is_assignable", &Variable::isAssignable);
+        return table;
+    }();
+    return table;
 }
 
 ::mstch::node Variable::qualifiedName()
@@ -1068,17 +1172,29 @@ Variable::Variable(const ::chimera::CompiledConfiguration &config,
 
 ::mstch::node Variable::namespaceScope()
 {
-    return generateNamespaceScope(config_, decl_->getDeclContext());
+    const DeclContext *decl_context = decl_->getDeclContext();
+    return sharedScope(config_, "context_namespace_scope", decl_context,
+                       [this, decl_context]() {
+                           return generateNamespaceScope(config_, decl_context);
+                       });
 }
 
 ::mstch::node Variable::classScope()
 {
-    return generateClassScope(config_, decl_->getDeclContext());
+    const DeclContext *decl_context = decl_->getDeclContext();
+    return sharedScope(config_, "context_class_scope", decl_context,
+                       [this, decl_context]() {
+                           return generateClassScope(config_, decl_context);
+                       });
 }
 
 ::mstch::node Variable::scope()
 {
-    return generateScope(config_, decl_->getDeclContext());
+    const DeclContext *decl_context = decl_->getDeclContext();
+    return sharedScope(config_, "context_scope", decl_context,
+                       [this, decl_context]() {
+                           return generateScope(config_, decl_context);
+                       });
 }
 
 ::mstch::node Variable::isAssignable()
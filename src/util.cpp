@@ -1,14 +1,27 @@
 #include "chimera/util.h"
 #include "cling_utils_AST.h"
 
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
 #include <clang/AST/ASTConsumer.h>
 #include <clang/AST/Mangle.h>
 #include <clang/Parse/Parser.h>
+#include <clang/Basic/CharInfo.h>
+#include <clang/Sema/Lookup.h>
 #include <clang/Sema/Sema.h>
 #include <clang/Sema/SemaDiagnostic.h>
 #include "clang/AST/DeclTemplate.h"
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
 
 namespace chimera
 {
@@ -33,15 +46,110 @@ static const QualType emptyType_;
 std::string generateUniqueName()
 {
     // Use a static variable to generate non-duplicate names.
-    static unsigned counter = 0;
+    // This is atomic since it may be used while rendering in parallel.
+    static std::atomic<unsigned> counter(0);
 
     std::stringstream ss;
     ss << "chimera_placeholder_" << (counter++);
     return ss.str();
 }
 
+/**
+ * Names derived from the declarations and types of a single ASTContext.
+ *
+ * Declarations are keyed by their canonical declaration.  Types are keyed by
+ * the exact (possibly sugared) QualType, since the qualified name of a
+ * typedef differs from the name of its canonical type.
+ */
+struct NameCache
+{
+    explicit NameCache(ASTContext &context)
+      : mangle_context(context.createMangleContext())
+    {
+    }
+
+    std::mutex mutex;
+    std::unique_ptr<MangleContext> mangle_context;
+    llvm::DenseMap<const Decl *, std::string> mangled_names;
+    llvm::DenseMap<const Decl *, std::string> binding_names;
+    llvm::DenseMap<QualType, std::string> qualified_type_names;
+};
+
+std::mutex &nameCacheRegistryMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::unordered_map<const ASTContext *, std::unique_ptr<NameCache>>
+    &nameCacheRegistry()
+{
+    static std::unordered_map<const ASTContext *, std::unique_ptr<NameCache>>
+        registry;
+    return registry;
+}
+
+/**
+ * Removes the cache of an ASTContext when the context is destroyed, so that
+ * a later context allocated at the same address starts with an empty cache.
+ */
+void releaseNameCache(void *context)
+{
+    std::lock_guard<std::mutex> lock(nameCacheRegistryMutex());
+    nameCacheRegistry().erase(static_cast<const ASTContext *>(context));
+}
+
+/**
+ * Returns the cache of an ASTContext, creating it on first use.
+ */
+NameCache &getNameCache(ASTContext &context)
+{
+    std::lock_guard<std::mutex> lock(nameCacheRegistryMutex());
+    std::unique_ptr<NameCache> &cache = nameCacheRegistry()[&context];
+    if (!cache)
+    {
+        cache.reset(new NameCache(context));
+        context.AddDeallocation(&releaseNameCache, &context);
+    }
+    return *cache;
+}
+
+/**
+ * Looks up a key in one of the maps of a NameCache, computing and inserting
+ * the value on a miss.
+ *
+ * The value is computed without holding the lock of the cache, since
+ * computing it may use the cache recursively.
+ */
+template <typename Map, typename Key, typename Compute>
+std::string lookupName(NameCache &cache, Map &map, const Key &key,
+                       Compute compute)
+{
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto it = map.find(key);
+        if (it != map.end())
+        {
+            ++NameCacheStats::hits;
+            return it->second;
+        }
+    }
+
+    ++NameCacheStats::misses;
+    std::string value = compute();
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    map.insert(std::make_pair(key, value));
+    return value;
+}
+
 } // namespace
 
+std::atomic<unsigned long> NameCacheStats::hits(0);
+std::atomic<unsigned long> NameCacheStats::misses(0);
+std::atomic<unsigned long> OutputStats::written(0);
+std::atomic<unsigned long> OutputStats::unchanged(0);
+
 ::mstch::node wrapYAMLNode(const YAML::Node &node, ScalarConversionFn fn)
 {
     switch (node.Type())
@@ -106,17 +214,18 @@ void extendWithYAMLNode(::mstch::map &map, const YAML::Node &node,
     }
 }
 
-const NamedDecl *resolveDeclaration(CompilerInstance *ci,
-                                    const llvm::StringRef declStr)
+namespace
 {
-    // Immediately return if passed an empty string.
-    if (declStr.empty())
-        return nullptr;
 
-    // Create a new parser to handle this type parsing.
+/**
+ * Sets up the preprocessor of a compiler instance to incrementally parse the
+ * declarations in `buffer`, and enters the buffer.
+ */
+FileID enterDeclarationBuffer(CompilerInstance *ci, Parser &parser,
+                              const std::string &buffer)
+{
     Preprocessor &preprocessor = ci->getPreprocessor();
     Sema &sema = ci->getSema();
-    Parser parser(preprocessor, sema, /* SkipFunctionBodies = */ false);
 
     // Set up the preprocessor to only care about incrementally handling type.
     preprocessor.getDiagnostics().setIgnoreAllWarnings(true);
@@ -129,9 +238,34 @@ const NamedDecl *resolveDeclaration(CompilerInstance *ci,
     // Put the type string into a buffer and run it through the preprocessor.
     FileID fid = sema.getSourceManager().createFileID(
         llvm::MemoryBuffer::getMemBufferCopy(
-            declStr.str() + ";", "chimera.util.resolveDeclaration"));
+            buffer, "chimera.util.resolveDeclaration"));
     preprocessor.EnterSourceFile(fid, /* DirLookup = */ 0, SourceLocation());
     parser.Initialize();
+    return fid;
+}
+
+/**
+ * Returns the number of errors that were reported by a compiler instance.
+ */
+unsigned getNumErrors(CompilerInstance *ci)
+{
+    const DiagnosticConsumer *client = ci->getDiagnostics().getClient();
+    return client ? client->getNumErrors() : 0;
+}
+
+} // namespace
+
+const NamedDecl *resolveDeclaration(CompilerInstance *ci,
+                                    const llvm::StringRef declStr)
+{
+    // Immediately return if passed an empty string.
+    if (declStr.empty())
+        return nullptr;
+
+    // Create a new parser to handle this type parsing.
+    Parser parser(ci->getPreprocessor(), ci->getSema(),
+                  /* SkipFunctionBodies = */ false);
+    enterDeclarationBuffer(ci, parser, declStr.str() + ";");
 
     // Try parsing the type name.
     Parser::DeclGroupPtrTy ADecl;
@@ -157,34 +291,19 @@ const NamedDecl *resolveDeclaration(CompilerInstance *ci,
 
 const QualType resolveType(CompilerInstance *ci, const llvm::StringRef typeStr)
 {
-    auto decl = resolveDeclaration(
-        ci, "typedef " + typeStr.str() + " " + generateUniqueName());
-    if (!decl)
-        return emptyType_;
-
-    if (!isa<TypedefDecl>(decl))
-    {
-        std::cerr << "Expected 'typedef' declaration, found '"
-                  << decl->getNameAsString() << "'." << std::endl;
-        return emptyType_;
-    }
-
-    auto typedef_decl = cast<TypedefDecl>(decl);
-    return typedef_decl->getUnderlyingType().getCanonicalType();
+    BatchResolver resolver(ci);
+    const std::size_t index = resolver.AddType(typeStr.str());
+    resolver.Resolve();
+    return resolver.GetType(index);
 }
 
 const RecordDecl *resolveRecord(CompilerInstance *ci,
                                 const llvm::StringRef recordStr)
 {
-    auto type = resolveType(ci, recordStr).getTypePtrOrNull();
-    if (!type)
-        return nullptr;
-
-    auto cxx_record_type = type->getAsCXXRecordDecl();
-    if (!cxx_record_type)
-        return nullptr;
-
-    return cast<RecordDecl>(cxx_record_type->getCanonicalDecl());
+    BatchResolver resolver(ci);
+    const std::size_t index = resolver.AddRecord(recordStr.str());
+    resolver.Resolve();
+    return resolver.GetRecord(index);
 }
 
 class TemplateDeclString
@@ -369,13 +488,286 @@ std::string makeTypeAliasTemplateString(const std::string &declStr)
 const clang::ClassTemplateDecl *resolveClassTemplate(
     CompilerInstance *ci, const llvm::StringRef recordStr)
 {
-    auto type_alias_template_str = makeTypeAliasTemplateString(recordStr.str());
+    BatchResolver resolver(ci);
+    const std::size_t index = resolver.AddClassTemplate(recordStr.str());
+    resolver.Resolve();
+    return resolver.GetClassTemplate(index);
+}
+
+const NamespaceDecl *resolveNamespace(CompilerInstance *ci,
+                                      const llvm::StringRef nsStr)
+{
+    BatchResolver resolver(ci);
+    const std::size_t index = resolver.AddNamespace(nsStr.str());
+    resolver.Resolve();
+    return resolver.GetNamespace(index);
+}
+
+const NamedDecl *lookupQualifiedName(CompilerInstance *ci,
+                                     const llvm::StringRef name)
+{
+    // Only handle names made of identifiers separated by `::`, with an
+    // optional leading `::`.  Anything else, e.g. template arguments or
+    // elaborated type specifiers, needs to be parsed.
+    llvm::StringRef qualified_name = name.trim();
+    if (qualified_name.startswith("::"))
+        qualified_name = qualified_name.drop_front(2);
+
+    llvm::SmallVector<llvm::StringRef, 4> components;
+    qualified_name.split(components, "::");
+    for (const llvm::StringRef component : components)
+    {
+        if (component.empty() || isDigit(component.front()))
+            return nullptr;
+        for (const char c : component)
+            if (!isIdentifierBody(c))
+                return nullptr;
+    }
+
+    Sema &sema = ci->getSema();
+    ASTContext &context = sema.getASTContext();
+    DeclContext *decl_context = context.getTranslationUnitDecl();
+    NamedDecl *found = nullptr;
+    for (std::size_t i = 0; i < components.size(); ++i)
+    {
+        // Each component is looked up in the namespace or (complete) class
+        // named by the previous components.
+        if (!decl_context)
+            return nullptr;
+
+        const bool is_last = (i + 1 == components.size());
+        LookupResult result(sema, &context.Idents.get(components[i]),
+                            SourceLocation(),
+                            is_last ? Sema::LookupOrdinaryName
+                                    : Sema::LookupNestedNameSpecifierName);
+        if (!sema.LookupQualifiedName(result, decl_context)
+            || !result.isSingleResult())
+            return nullptr;
+        found = result.getFoundDecl();
+
+        decl_context = nullptr;
+        if (auto alias_decl = dyn_cast<NamespaceAliasDecl>(found))
+            decl_context = alias_decl->getNamespace();
+        else if (auto namespace_decl = dyn_cast<NamespaceDecl>(found))
+            decl_context = namespace_decl;
+        else if (auto type_decl = dyn_cast<TypeDecl>(found))
+        {
+            if (auto record_decl
+                = context.getTypeDeclType(type_decl)->getAsCXXRecordDecl())
+                decl_context = record_decl->getDefinition();
+        }
+    }
+    return found;
+}
+
+BatchResolver::BatchResolver(CompilerInstance *ci) : ci_(ci)
+{
+    // Do nothing.
+}
+
+std::size_t BatchResolver::AddDeclaration(const std::string &declStr)
+{
+    return Add(declStr, declStr, Kind::Declaration);
+}
+
+std::size_t BatchResolver::AddType(const std::string &typeStr)
+{
+    return Add(typeStr, "typedef " + typeStr + " " + generateUniqueName(),
+               Kind::Type);
+}
+
+std::size_t BatchResolver::AddRecord(const std::string &recordStr)
+{
+    return AddType(recordStr);
+}
+
+std::size_t BatchResolver::AddClassTemplate(const std::string &recordStr)
+{
+    return Add(recordStr, makeTypeAliasTemplateString(recordStr),
+               Kind::ClassTemplate);
+}
+
+std::size_t BatchResolver::AddNamespace(const std::string &nsStr)
+{
+    return Add(nsStr, "namespace " + generateUniqueName() + " = " + nsStr,
+               Kind::Namespace);
+}
+
+std::size_t BatchResolver::Add(const std::string &str, std::string declStr,
+                               Kind kind)
+{
+    Entry entry;
+    entry.declStr = std::move(declStr);
+    entry.kind = kind;
+    entry.decl = nullptr;
+    entry.resolved = false;
+    entry.looked_up = false;
+
+    // Try to resolve types and namespaces by name lookup.  If the name does
+    // not refer to a declaration of the expected kind, it is parsed instead,
+    // so that the same errors are reported as before.
+    const NamedDecl *found = nullptr;
+    if (kind == Kind::Type || kind == Kind::Namespace)
+        found = lookupQualifiedName(ci_, str);
+
+    if (kind == Kind::Type && found && isa<TypeDecl>(found))
+    {
+        entry.decl = cast<NamedDecl>(found->getCanonicalDecl());
+        entry.resolved = entry.looked_up = true;
+    }
+    else if (kind == Kind::Namespace && found
+             && (isa<NamespaceDecl>(found) || isa<NamespaceAliasDecl>(found)))
+    {
+        if (auto alias_decl = dyn_cast<NamespaceAliasDecl>(found))
+            found = alias_decl->getNamespace();
+        entry.decl = cast<NamedDecl>(found->getCanonicalDecl());
+        entry.resolved = entry.looked_up = true;
+    }
+    else if (entry.declStr.empty())
+    {
+        // resolveDeclaration() does not parse empty strings.
+        entry.resolved = true;
+    }
+
+    entries_.push_back(std::move(entry));
+    return entries_.size() - 1;
+}
+
+void BatchResolver::Resolve()
+{
+    // Put every string that needs to be parsed into a single buffer, and
+    // remember where each of them starts.
+    std::vector<std::size_t> pending;
+    std::vector<unsigned> offsets;
+    std::string buffer;
+    for (std::size_t i = 0; i < entries_.size(); ++i)
+    {
+        Entry &entry = entries_[i];
+        if (entry.resolved)
+            continue;
+
+        pending.push_back(i);
+        offsets.push_back(buffer.size());
+        buffer += entry.declStr + ";\n";
+        entry.resolved = true;
+    }
+    if (pending.empty())
+        return;
+
+    // Like resolveDeclaration(), each string is resolved to the first
+    // declaration that is parsed from it.  Strings are marked as unclean if
+    // an error was reported while parsing their first declaration.
+    std::vector<bool> parsed(pending.size(), false);
+    std::vector<bool> clean(pending.size(), false);
+    {
+        // The parser must be destroyed before any string is parsed again.
+        Parser parser(ci_->getPreprocessor(), ci_->getSema(),
+                      /* SkipFunctionBodies = */ false);
+        const FileID fid = enterDeclarationBuffer(ci_, parser, buffer);
+        const SourceManager &source_manager = ci_->getSourceManager();
+
+        Parser::DeclGroupPtrTy ADecl;
+        for (;;)
+        {
+            const unsigned num_errors = getNumErrors(ci_);
+            if (parser.ParseTopLevelDecl(ADecl))
+                break;
+            if (!ADecl)
+                continue;
+
+            const bool has_errors = (getNumErrors(ci_) != num_errors);
+            for (Decl *decl : ADecl.get())
+            {
+                const SourceLocation location
+                    = source_manager.getExpansionLoc(decl->getLocation());
+                if (location.isInvalid()
+                    || source_manager.getFileID(location) != fid)
+                    continue;
+
+                // Find the string that contains the declaration.
+                const unsigned offset = source_manager.getFileOffset(location);
+                const std::size_t index
+                    = std::upper_bound(offsets.begin(), offsets.end(), offset)
+                      - offsets.begin() - 1;
+                if (parsed[index])
+                    continue;
+
+                parsed[index] = true;
+                clean[index] = !has_errors;
+                entries_[pending[index]].decl
+                    = dyn_cast<NamedDecl>(decl->getCanonicalDecl());
+            }
+        }
+    }
+
+    for (std::size_t index = 0; index < pending.size(); ++index)
+    {
+        Entry &entry = entries_[pending[index]];
+        if (pending.size() == 1)
+        {
+            // Errors can only be caused by the string itself.
+            if (!parsed[index])
+                std::cerr << "Failed to parse '" << entry.declStr << "'."
+                          << std::endl;
+        }
+        else if (!parsed[index] || !clean[index])
+        {
+            // The error may have been caused by another string, so parse the
+            // string on its own to attribute the error to the right string.
+            entry.decl = resolveDeclaration(ci_, entry.declStr);
+        }
+    }
+}
+
+const NamedDecl *BatchResolver::GetDeclaration(std::size_t index) const
+{
+    return entries_.at(index).decl;
+}
+
+QualType BatchResolver::GetType(std::size_t index) const
+{
+    const Entry &entry = entries_.at(index);
+    if (!entry.decl)
+        return emptyType_;
+
+    if (entry.looked_up)
+        return ci_->getASTContext()
+            .getTypeDeclType(cast<TypeDecl>(entry.decl))
+            .getCanonicalType();
+
+    if (!isa<TypedefDecl>(entry.decl))
+    {
+        std::cerr << "Expected 'typedef' declaration, found '"
+                  << entry.decl->getNameAsString() << "'." << std::endl;
+        return emptyType_;
+    }
+
+    auto typedef_decl = cast<TypedefDecl>(entry.decl);
+    return typedef_decl->getUnderlyingType().getCanonicalType();
+}
+
+const RecordDecl *BatchResolver::GetRecord(std::size_t index) const
+{
+    auto type = GetType(index).getTypePtrOrNull();
+    if (!type)
+        return nullptr;
 
-    auto decl = resolveDeclaration(ci, type_alias_template_str);
+    auto cxx_record_type = type->getAsCXXRecordDecl();
+    if (!cxx_record_type)
+        return nullptr;
+
+    return cast<RecordDecl>(cxx_record_type->getCanonicalDecl());
+}
+
+const ClassTemplateDecl *BatchResolver::GetClassTemplate(
+    std::size_t index) const
+{
+    const Entry &entry = entries_.at(index);
+    auto decl = entry.decl;
     if (!decl)
     {
         std::cerr << "Failed to parse following template type alias:\n\n"
-                  << type_alias_template_str << std::endl;
+                  << entry.declStr << std::endl;
         return nullptr;
     }
 
@@ -399,14 +791,16 @@ const clang::ClassTemplateDecl *resolveClassTemplate(
     return dyn_cast<ClassTemplateDecl>(template_decl->getCanonicalDecl());
 }
 
-const NamespaceDecl *resolveNamespace(CompilerInstance *ci,
-                                      const llvm::StringRef nsStr)
+const NamespaceDecl *BatchResolver::GetNamespace(std::size_t index) const
 {
-    auto decl = resolveDeclaration(
-        ci, "namespace " + generateUniqueName() + " = " + nsStr.str());
+    const Entry &entry = entries_.at(index);
+    auto decl = entry.decl;
     if (!decl)
         return nullptr;
 
+    if (entry.looked_up)
+        return cast<NamespaceDecl>(decl);
+
     if (!isa<NamespaceAliasDecl>(decl))
     {
         std::cerr << "Expected 'namespace' alias declaration, found '"
@@ -419,14 +813,32 @@ const NamespaceDecl *resolveNamespace(CompilerInstance *ci,
 
 std::string constructMangledName(const NamedDecl *decl)
 {
+    NameCache &cache = getNameCache(decl->getASTContext());
+    const Decl *key = decl->getCanonicalDecl();
+
+    // The mangle context is shared, so names are mangled while holding the
+    // lock of the cache.
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto it = cache.mangled_names.find(key);
+    if (it != cache.mangled_names.end())
+    {
+        ++NameCacheStats::hits;
+        return it->second;
+    }
+    ++NameCacheStats::misses;
+
     std::string mangled_name;
     llvm::raw_string_ostream mangled_name_stream(mangled_name);
-    decl->getASTContext().createMangleContext()->mangleName(
-        decl, mangled_name_stream);
-    return mangled_name_stream.str();
+    cache.mangle_context->mangleName(decl, mangled_name_stream);
+    mangled_name_stream.flush();
+    cache.mangled_names.insert(std::make_pair(key, mangled_name));
+    return mangled_name;
 }
 
-std::string constructBindingName(const CXXRecordDecl *decl)
+namespace
+{
+
+std::string constructBindingNameUncached(const CXXRecordDecl *decl)
 {
     // If this is an anonymous struct, then use the name of its typedef.
     if (TypedefNameDecl *typedef_decl = decl->getTypedefNameForAnonDecl())
@@ -453,6 +865,15 @@ std::string constructBindingName(const CXXRecordDecl *decl)
     return mangled_name;
 }
 
+} // namespace
+
+std::string constructBindingName(const CXXRecordDecl *decl)
+{
+    NameCache &cache = getNameCache(decl->getASTContext());
+    return lookupName(cache, cache.binding_names, decl->getCanonicalDecl(),
+                      [decl]() { return constructBindingNameUncached(decl); });
+}
+
 QualType getFullyQualifiedType(ASTContext &context, QualType qt)
 {
     return cling::utils::TypeName::GetFullyQualifiedType(qt, context);
@@ -460,7 +881,10 @@ QualType getFullyQualifiedType(ASTContext &context, QualType qt)
 
 std::string getFullyQualifiedTypeName(ASTContext &context, QualType qt)
 {
-    return cling::utils::TypeName::GetFullyQualifiedName(qt, context);
+    NameCache &cache = getNameCache(context);
+    return lookupName(cache, cache.qualified_type_names, qt, [&]() {
+        return cling::utils::TypeName::GetFullyQualifiedName(qt, context);
+    });
 }
 
 std::string getFullyQualifiedDeclTypeAsString(const TypeDecl *decl)
@@ -697,9 +1121,10 @@ std::vector<std::string> getTemplateParameterStrings(const std::string &type)
     return args;
 }
 
-std::set<const CXXRecordDecl *> getBaseClassDecls(const CXXRecordDecl *decl)
+std::vector<const CXXRecordDecl *> getBaseClassDecls(
+    const CXXRecordDecl *decl)
 {
-    std::set<const CXXRecordDecl *> base_decls;
+    std::vector<const CXXRecordDecl *> base_decls;
 
     for (const CXXBaseSpecifier &base_decl : decl->bases())
     {
@@ -708,26 +1133,27 @@ std::set<const CXXRecordDecl *> getBaseClassDecls(const CXXRecordDecl *decl)
 
         // TODO: Filter out transitive base classes.
 
-        base_decls.insert(base_decl.getType()->getAsCXXRecordDecl());
+        base_decls.push_back(base_decl.getType()->getAsCXXRecordDecl());
     }
 
     return base_decls;
 }
 
-std::set<const CXXRecordDecl *> getBaseClassDecls(
+std::vector<const CXXRecordDecl *> getBaseClassDecls(
     const CXXRecordDecl *decl, std::set<const CXXRecordDecl *> available_decls)
 {
     // Get all base classes.
-    std::set<const CXXRecordDecl *> all_base_decls = getBaseClassDecls(decl);
+    std::vector<const CXXRecordDecl *> all_base_decls
+        = getBaseClassDecls(decl);
 
     // Filter the classes by availability.
-    std::set<const CXXRecordDecl *> base_decls;
+    std::vector<const CXXRecordDecl *> base_decls;
     for (const CXXRecordDecl *base_decl : all_base_decls)
     {
         const bool base_available = available_decls.count(base_decl);
 
         if (base_available)
-            base_decls.insert(base_decl);
+            base_decls.push_back(base_decl);
         else
         {
             std::cerr << "Warning: Omitted base class '"
@@ -770,153 +1196,280 @@ bool containsIncompleteType(Sema &sema, QualType qual_type)
     }
 }
 
-bool containsIncompleteType(Sema &sema, const FunctionDecl *decl)
+std::pair<unsigned, unsigned> getFunctionArgumentRange(
+    const clang::FunctionDecl *decl)
 {
-    for (unsigned int iparam = 0; iparam < decl->getNumParams(); ++iparam)
+    const unsigned max_arguments = decl->getNumParams();
+
+    unsigned min_arguments = 0;
+    for (; min_arguments < max_arguments; ++min_arguments)
     {
-        const ParmVarDecl *const param_decl = decl->getParamDecl(iparam);
-        if (containsIncompleteType(sema, param_decl->getOriginalType()))
-        {
-            std::cerr << "Warning: Skipped function '"
-                      << decl->getQualifiedNameAsString() << "' because";
+        if (decl->getParamDecl(min_arguments)->hasDefaultArg())
+            break;
+    }
 
-            if (param_decl->getNameAsString().empty())
-                std::cerr << " the parameter at index " << iparam;
-            else
-                std::cerr << " parameter '" << param_decl->getNameAsString()
-                          << "'";
+    return std::pair<unsigned, unsigned>(min_arguments, max_arguments);
+}
 
-            std::cerr << " has an incomplete type '"
-                      << getFullyQualifiedTypeName(decl->getASTContext(),
-                                                   param_decl->getType())
-                      << "'.\n";
-            return true;
-        }
+namespace
+{
+
+/**
+ * Returns the deepest nesting of class template specializations in a type,
+ * e.g. 2 for `std::vector<std::pair<int, int>> &`.
+ */
+unsigned getTemplateDepth(QualType type)
+{
+    type = type.getCanonicalType();
+    while (type->isPointerType() || type->isReferenceType())
+        type = type->getPointeeType().getCanonicalType();
+
+    auto specialization_decl
+        = dyn_cast_or_null<ClassTemplateSpecializationDecl>(
+            type->getAsCXXRecordDecl());
+    if (!specialization_decl)
+        return 0;
+
+    unsigned depth = 0;
+    const TemplateArgumentList &args = specialization_decl->getTemplateArgs();
+    for (unsigned i = 0; i < args.size(); ++i)
+    {
+        if (args[i].getKind() == TemplateArgument::Type)
+            depth = std::max(depth, getTemplateDepth(args[i].getAsType()));
     }
-    return false;
+    return depth + 1;
 }
 
-bool containsRValueReference(const FunctionDecl *decl)
+unsigned getTemplateDepth(const FunctionDecl *decl)
 {
-    for (unsigned int iparam = 0; iparam < decl->getNumParams(); ++iparam)
+    unsigned depth = getTemplateDepth(decl->getReturnType());
+    for (auto i = 0u; i < decl->getNumParams(); ++i)
     {
-        const ParmVarDecl *const param_decl = decl->getParamDecl(iparam);
-        if (param_decl->getType().getTypePtr()->isRValueReferenceType())
-        {
-            std::cerr << "Warning: Skipped function '"
-                      << decl->getQualifiedNameAsString() << "' because";
-
-            if (param_decl->getNameAsString().empty())
-                std::cerr << " the parameter at index " << iparam;
-            else
-                std::cerr << " parameter '" << param_decl->getNameAsString()
-                          << "'";
-
-            std::cerr << " is an rvalue reference of type '"
-                      << getFullyQualifiedTypeName(decl->getASTContext(),
-                                                   param_decl->getType())
-                      << "'.\n";
-
-            return true;
-        }
+        depth = std::max(depth,
+                         getTemplateDepth(decl->getParamDecl(i)->getType()));
     }
-    return false;
+    return depth;
 }
 
-bool containsNonCopyableType(const FunctionDecl *decl)
+} // namespace
+
+unsigned estimateCompileCost(const NamedDecl *decl)
 {
-    for (unsigned int iparam = 0; iparam < decl->getNumParams(); ++iparam)
+    unsigned functions = 1;
+    unsigned depth = 0;
+
+    if (auto record_decl = dyn_cast<CXXRecordDecl>(decl))
     {
-        const ParmVarDecl *const param_decl = decl->getParamDecl(iparam);
-        const clang::Type *const param_type
-            = param_decl->getType().getTypePtr();
+        depth = getTemplateDepth(
+            decl->getASTContext().getTypeDeclType(record_decl));
 
-        if (!param_type->isReferenceType() && !param_type->isPointerType()
-            && !isCopyable(decl->getASTContext(), param_decl->getType()))
+        if (record_decl->hasDefinition())
         {
-            std::cerr << "Warning: Skipped function '"
-                      << decl->getQualifiedNameAsString() << "' because";
-
-            if (param_decl->getNameAsString().empty())
-                std::cerr << " the parameter at index " << iparam;
-            else
-                std::cerr << " parameter '" << param_decl->getNameAsString()
-                          << "'";
+            record_decl = record_decl->getDefinition();
+            for (const CXXMethodDecl *method_decl : record_decl->methods())
+            {
+                if (method_decl->getAccess() != AS_public
+                    || method_decl->isDeleted())
+                    continue;
 
-            std::cerr << " has a non-copyable type '"
-                      << getFullyQualifiedTypeName(decl->getASTContext(),
-                                                   param_decl->getType())
-                      << "'.\n";
+                ++functions;
+                depth = std::max(depth, getTemplateDepth(method_decl));
+            }
+            for (const FieldDecl *field_decl : record_decl->fields())
+            {
+                if (field_decl->getAccess() != AS_public)
+                    continue;
 
-            return true;
+                ++functions;
+                depth
+                    = std::max(depth, getTemplateDepth(field_decl->getType()));
+            }
         }
     }
-    return false;
-}
-
-bool needsReturnValuePolicy(const NamedDecl *decl, QualType return_type)
-{
-    if (return_type.getTypePtr()->isReferenceType())
+    else if (auto function_decl = dyn_cast<FunctionDecl>(decl))
     {
-        std::cerr << "Warning: Skipped method '"
-                  << decl->getQualifiedNameAsString()
-                  << "' because it returns the reference type '"
-                  << getFullyQualifiedTypeName(decl->getASTContext(),
-                                               return_type)
-                  << "' and no 'return_value_policy' was specified.\n";
-        return true;
+        depth = getTemplateDepth(function_decl);
     }
-    else if (return_type.getTypePtr()->isPointerType())
+    else if (auto var_decl = dyn_cast<VarDecl>(decl))
     {
-        std::cerr << "Warning: Skipped method '"
-                  << decl->getQualifiedNameAsString()
-                  << "' because it returns the pointer type '"
-                  << getFullyQualifiedTypeName(decl->getASTContext(),
-                                               return_type)
-                  << "' and no 'return_value_policy' was specified.\n";
-        return true;
+        depth = getTemplateDepth(var_decl->getType());
     }
-    return false;
+
+    return functions * (depth + 1);
 }
 
-std::pair<unsigned, unsigned> getFunctionArgumentRange(
-    const clang::FunctionDecl *decl)
+namespace
 {
-    const unsigned max_arguments = decl->getNumParams();
 
-    unsigned min_arguments = 0;
-    for (; min_arguments < max_arguments; ++min_arguments)
+void collectTypeDecls(QualType type, std::set<const Type *> &visited,
+                      std::vector<const Decl *> &decls);
+
+void collectTemplateArgumentDecls(const TemplateArgument &arg,
+                                  std::set<const Type *> &visited,
+                                  std::vector<const Decl *> &decls)
+{
+    switch (arg.getKind())
     {
-        if (decl->getParamDecl(min_arguments)->hasDefaultArg())
+        case TemplateArgument::Type:
+            collectTypeDecls(arg.getAsType(), visited, decls);
+            break;
+        case TemplateArgument::Template:
+            if (auto template_decl = arg.getAsTemplate().getAsTemplateDecl())
+                decls.push_back(template_decl);
+            break;
+        case TemplateArgument::Pack:
+            for (auto it = arg.pack_begin(); it != arg.pack_end(); ++it)
+                collectTemplateArgumentDecls(*it, visited, decls);
+            break;
+        default:
             break;
     }
-
-    return std::pair<unsigned, unsigned>(min_arguments, max_arguments);
 }
 
-bool hasNonPublicParam(const CXXMethodDecl *decl)
+/**
+ * Collects the declarations that a type refers to, including the typedefs
+ * that it is spelled with and the arguments of template specializations.
+ */
+void collectTypeDecls(QualType type, std::set<const Type *> &visited,
+                      std::vector<const Decl *> &decls)
 {
-    for (auto i = 0u; i < decl->getNumParams(); ++i)
+    if (type.isNull() || !visited.insert(type.getTypePtr()).second)
+        return;
+
+    const Type *type_ptr = type.getTypePtr();
+    if (auto typedef_type = dyn_cast<TypedefType>(type_ptr))
+    {
+        decls.push_back(typedef_type->getDecl());
+    }
+    else if (auto elaborated_type = dyn_cast<ElaboratedType>(type_ptr))
+    {
+        collectTypeDecls(elaborated_type->getNamedType(), visited, decls);
+    }
+    else if (auto specialization_type
+             = dyn_cast<TemplateSpecializationType>(type_ptr))
+    {
+        if (auto template_decl
+            = specialization_type->getTemplateName().getAsTemplateDecl())
+            decls.push_back(template_decl);
+        for (unsigned i = 0; i < specialization_type->getNumArgs(); ++i)
+            collectTemplateArgumentDecls(specialization_type->getArg(i),
+                                         visited, decls);
+    }
+    else if (auto tag_type = dyn_cast<TagType>(type_ptr))
     {
-        const ParmVarDecl *param_decl = decl->getParamDecl(i);
-        QualType param_type = param_decl->getType();
-        if (param_type->isReferenceType())
+        decls.push_back(tag_type->getDecl());
+        if (auto specialization_decl
+            = dyn_cast<ClassTemplateSpecializationDecl>(tag_type->getDecl()))
         {
-            param_type = param_type.getNonReferenceType();
+            const TemplateArgumentList &args
+                = specialization_decl->getTemplateArgs();
+            for (unsigned i = 0; i < args.size(); ++i)
+                collectTemplateArgumentDecls(args[i], visited, decls);
         }
-        // TODO: are there any other special cases than reference type?
+    }
+    else if (!type_ptr->getPointeeType().isNull())
+    {
+        collectTypeDecls(type_ptr->getPointeeType(), visited, decls);
+    }
+    else if (auto array_type = type_ptr->getAsArrayTypeUnsafe())
+    {
+        collectTypeDecls(array_type->getElementType(), visited, decls);
+    }
+    else if (auto function_type = dyn_cast<FunctionProtoType>(type_ptr))
+    {
+        collectTypeDecls(function_type->getReturnType(), visited, decls);
+        for (unsigned i = 0; i < function_type->getNumParams(); ++i)
+            collectTypeDecls(function_type->getParamType(i), visited, decls);
+    }
 
-        if (auto record_type = dyn_cast<RecordType>(param_type))
+    // The canonical type refers to the declarations behind the sugar.
+    collectTypeDecls(type.getCanonicalType(), visited, decls);
+}
+
+void collectFunctionDecls(const FunctionDecl *decl,
+                          std::set<const Type *> &visited,
+                          std::vector<const Decl *> &decls)
+{
+    collectTypeDecls(decl->getReturnType(), visited, decls);
+    for (unsigned i = 0; i < decl->getNumParams(); ++i)
+        collectTypeDecls(decl->getParamDecl(i)->getType(), visited, decls);
+}
+
+} // namespace
+
+std::vector<const Decl *> getReferencedDecls(const Decl *decl)
+{
+    std::set<const Type *> visited;
+    std::vector<const Decl *> decls;
+    if (auto record_decl = dyn_cast<CXXRecordDecl>(decl))
+    {
+        if (record_decl->hasDefinition())
         {
-            CXXRecordDecl *cxx_record_decl
-                = cast<CXXRecordDecl>(record_type->getDecl());
-            if (cxx_record_decl->getAccess() != AS_public)
+            record_decl = record_decl->getDefinition();
+            for (const CXXBaseSpecifier &base : record_decl->bases())
+                collectTypeDecls(base.getType(), visited, decls);
+            for (const CXXMethodDecl *method_decl : record_decl->methods())
             {
-                return true;
+                if (method_decl->getAccess() == AS_public)
+                    collectFunctionDecls(method_decl, visited, decls);
+            }
+            for (const FieldDecl *field_decl : record_decl->fields())
+            {
+                if (field_decl->getAccess() == AS_public)
+                    collectTypeDecls(field_decl->getType(), visited, decls);
             }
         }
     }
-    return false;
+    else if (auto function_decl = dyn_cast<FunctionDecl>(decl))
+    {
+        collectFunctionDecls(function_decl, visited, decls);
+    }
+    else if (auto value_decl = dyn_cast<ValueDecl>(decl))
+    {
+        collectTypeDecls(value_decl->getType(), visited, decls);
+    }
+    else if (auto typedef_decl = dyn_cast<TypedefNameDecl>(decl))
+    {
+        collectTypeDecls(typedef_decl->getUnderlyingType(), visited, decls);
+    }
+    return decls;
+}
+
+std::vector<const FileEntry *> getRequiredFiles(const SourceManager &sm,
+                                                const NamedDecl *decl)
+{
+    // Collect the declaration itself, followed by the declarations of the
+    // types that its binding refers to.
+    std::vector<const Decl *> decls{decl};
+    const std::vector<const Decl *> referenced_decls = getReferencedDecls(decl);
+    decls.insert(decls.end(), referenced_decls.begin(), referenced_decls.end());
+
+    std::vector<const FileEntry *> files;
+    for (const Decl *required_decl : decls)
+    {
+        SourceLocation loc = sm.getExpansionLoc(required_decl->getLocation());
+        if (loc.isInvalid())
+            continue;
+
+        // Headers that are included by system headers are internal to their
+        // library, so the system header that was included by a user header
+        // is included instead, e.g. <vector> instead of <bits/stl_vector.h>.
+        FileID file_id = sm.getFileID(loc);
+        while (sm.isInSystemHeader(loc))
+        {
+            const SourceLocation include_loc = sm.getIncludeLoc(file_id);
+            if (include_loc.isInvalid() || !sm.isInSystemHeader(include_loc))
+                break;
+            loc = include_loc;
+            file_id = sm.getFileID(loc);
+        }
+
+        // Builtin declarations are not in any file.
+        const FileEntry *file = sm.getFileEntryForID(file_id);
+        if (file && std::find(files.begin(), files.end(), file) == files.end())
+            files.push_back(file);
+    }
+    return files;
 }
 
 std::string trimRight(std::string s, const char *t)
@@ -942,6 +1495,153 @@ bool startsWith(const std::string &str, const std::string &prefix)
             && std::equal(prefix.begin(), prefix.end(), str.begin()));
 }
 
+std::string hashContent(llvm::StringRef content)
+{
+    llvm::MD5 hash;
+    hash.update(content);
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+
+    llvm::SmallString<32> hex;
+    llvm::MD5::stringifyResult(result, hex);
+    return hex.str();
+}
+
+bool writeFileIfChanged(const std::string &path, const std::string &content)
+{
+    // Only read the existing file if it has the same size.
+    uint64_t size;
+    if (!llvm::sys::fs::file_size(path, size) && size == content.size())
+    {
+        auto existing = llvm::MemoryBuffer::getFile(path);
+        if (existing
+            && hashContent((*existing)->getBuffer()) == hashContent(content))
+        {
+            ++OutputStats::unchanged;
+            return true;
+        }
+    }
+
+    int fd;
+    llvm::SmallString<256> temp_path;
+    if (llvm::sys::fs::createUniqueFile(path + "-%%%%%%%%.tmp", fd, temp_path))
+        return false;
+
+    llvm::raw_fd_ostream stream(fd, /* shouldClose = */ true);
+    stream << content;
+    stream.close();
+    if (stream.has_error())
+    {
+        stream.clear_error();
+        llvm::sys::fs::remove(temp_path);
+        return false;
+    }
+
+    if (llvm::sys::fs::rename(temp_path, path))
+    {
+        llvm::sys::fs::remove(temp_path);
+        return false;
+    }
+
+    ++OutputStats::written;
+    return true;
+}
+
+namespace
+{
+
+/**
+ * Escapes a path for a Makefile rule, in the same way as the depfiles that
+ * are written by GCC and Clang.
+ */
+std::string escapeMakePath(const std::string &path)
+{
+    std::string escaped;
+    for (const char c : path)
+    {
+        if (c == ' ' || c == '#')
+            escaped += '\\';
+        else if (c == '$')
+            escaped += '$';
+        escaped += c;
+    }
+    return escaped;
+}
+
+} // namespace
+
+namespace
+{
+
+/**
+ * Quotes and escapes a string for a JSON document.
+ */
+std::string quoteJson(const std::string &str)
+{
+    std::stringstream ss;
+    ss << '"';
+    for (const char c : str)
+    {
+        if (c == '"' || c == '\\')
+            ss << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            ss << "\\u" << std::hex << std::setfill('0') << std::setw(4)
+               << static_cast<int>(c) << std::dec;
+        else
+            ss << c;
+    }
+    ss << '"';
+    return ss.str();
+}
+
+} // namespace
+
+bool writeManifest(const std::string &path, const std::string &module_name,
+                   const std::string &output_path,
+                   const std::vector<std::string> &files)
+{
+    std::error_code error;
+    llvm::raw_fd_ostream stream(path, error, llvm::sys::fs::F_Text);
+    if (error)
+        return false;
+
+    stream << "{\n"
+           << "  \"module\": " << quoteJson(module_name) << ",\n"
+           << "  \"output_path\": " << quoteJson(output_path) << ",\n"
+           << "  \"files\": [";
+    for (std::size_t i = 0; i < files.size(); ++i)
+        stream << (i ? ",\n    " : "\n    ") << quoteJson(files[i]);
+    stream << (files.empty() ? "]\n" : "\n  ]\n") << "}\n";
+    stream.close();
+    if (stream.has_error())
+    {
+        stream.clear_error();
+        return false;
+    }
+    return true;
+}
+
+bool writeDepfile(const std::string &path, const std::string &target,
+                  const std::set<std::string> &dependencies)
+{
+    std::error_code error;
+    llvm::raw_fd_ostream stream(path, error, llvm::sys::fs::F_Text);
+    if (error)
+        return false;
+
+    stream << escapeMakePath(target) << ":";
+    for (const auto &dependency : dependencies)
+        stream << " \\\n  " << escapeMakePath(dependency);
+    stream << "\n";
+    stream.close();
+    if (stream.has_error())
+    {
+        stream.clear_error();
+        return false;
+    }
+    return true;
+}
+
 std::string toString(QualType qual_type)
 {
     return toString(qual_type.getTypePtr());
@@ -1160,7 +1860,10 @@ std::string stripNoneCopyableEigenWrapper_NonQualifiered(std::string type)
     return type;
 }
 
-std::string stripNoneCopyableEigenWrappers(std::string type)
+namespace
+{
+
+std::string stripNoneCopyableEigenWrappersUncached(std::string type)
 {
     if (type.empty())
         return type;
@@ -1189,5 +1892,32 @@ std::string stripNoneCopyableEigenWrappers(std::string type)
            + suffix;
 }
 
+} // namespace
+
+std::string stripNoneCopyableEigenWrappers(std::string type)
+{
+    // The stripped strings only depend on the type string, so they are shared
+    // by all ASTContexts.
+    static std::mutex mutex;
+    static llvm::StringMap<std::string> stripped_types;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = stripped_types.find(type);
+        if (it != stripped_types.end())
+        {
+            ++NameCacheStats::hits;
+            return it->second;
+        }
+    }
+
+    ++NameCacheStats::misses;
+    std::string stripped = stripNoneCopyableEigenWrappersUncached(type);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stripped_types[type] = stripped;
+    return stripped;
+}
+
 } // namespace util
 } // namespace chimera
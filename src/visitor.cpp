@@ -74,6 +74,9 @@ CXXRecordDecl *GetEnclosingClassDecl(Decl *decl)
 
 } // namespace
 
+std::atomic<unsigned long> chimera::TraversalStats::visited_decls(0);
+std::atomic<unsigned long> chimera::TraversalStats::skipped_decls(0);
+
 chimera::Visitor::Visitor(clang::CompilerInstance *ci,
                           std::unique_ptr<CompiledConfiguration> cc)
   : printing_policy_(ci->getLangOpts()), config_(std::move(cc))
@@ -91,8 +94,27 @@ bool chimera::Visitor::shouldVisitImplicitCode() const
     return true;
 }
 
+bool chimera::Visitor::TraverseDecl(Decl *decl)
+{
+    // The translation unit is never pruned, since it encloses everything.
+    if (decl && !isa<TranslationUnitDecl>(decl) && config_->IsPruned(decl))
+    {
+        ++TraversalStats::skipped_decls;
+        return true;
+    }
+
+    return RecursiveASTVisitor<Visitor>::TraverseDecl(decl);
+}
+
+void chimera::Visitor::RenderBindings()
+{
+    config_->RenderQueued();
+}
+
 bool chimera::Visitor::VisitDecl(Decl *decl)
 {
+    ++TraversalStats::visited_decls;
+
     // Only visit declarations in namespaces we are configured to read.
     if (config_->IsSuppressed(decl))
         return true;
@@ -205,7 +227,7 @@ bool chimera::Visitor::GenerateCXXRecord(CXXRecordDecl *decl)
         return false;
 
     // Ensure traversal of base classes before this class.
-    std::set<const CXXRecordDecl *> base_decls
+    const std::vector<const CXXRecordDecl *> base_decls
         = chimera::util::getBaseClassDecls(decl);
     for (auto base_decl : base_decls)
     {
@@ -217,6 +239,10 @@ bool chimera::Visitor::GenerateCXXRecord(CXXRecordDecl *decl)
     // Serialize using a mstch template.
     auto context = std::make_shared<chimera::mstch::CXXRecord>(
         *config_, decl, &traversed_class_decls_);
+
+    // Resolve the bases now, since bindings are rendered after traversal,
+    // when the set of traversed classes also contains later classes.
+    context->at("bases");
     return config_->Render(context);
 }
 
@@ -239,7 +265,9 @@ bool chimera::Visitor::GenerateGlobalVar(clang::VarDecl *decl)
         return false;
 
     // TODO: Support return_value_policy for global variables.
-    if (chimera::util::needsReturnValuePolicy(decl, decl->getType()))
+    if (!config_->GetEligibility()
+             .CheckReturnType(decl, decl->getType())
+             .eligible())
         return false;
 
     // Serialize using a mstch template.
@@ -263,21 +291,15 @@ bool chimera::Visitor::GenerateGlobalFunction(clang::FunctionDecl *decl)
     else if (decl->getDescribedFunctionTemplate())
         return false;
 
-    // Skip functions that have incomplete argument types. Boost.Python
-    // requires RTTI information about all arguments, including references and
-    // pointers.
-    if (chimera::util::containsIncompleteType(
-            config_->GetCompilerInstance()->getSema(), decl))
-        return false;
-
-    // Skip functions that have non-copyable argument types passed by value.
-    // Using these functions requires std::move()-ing their arguments, which
-    // we generally cannot do.
-    if (chimera::util::containsNonCopyableType(decl))
+    // Skip functions whose parameters cannot be bound, e.g. because they
+    // have incomplete or non-copyable types (see EligibilityAnalysis).
+    if (!config_->GetEligibility().CheckParameters(decl).eligible())
         return false;
 
     // TODO: Support return_value_policy for global functions.
-    if (chimera::util::needsReturnValuePolicy(decl, decl->getType()))
+    if (!config_->GetEligibility()
+             .CheckReturnType(decl, decl->getType())
+             .eligible())
         return false;
 
     // Serialize using a mstch template.
@@ -1,9 +1,13 @@
 #include "emulator.h"
 
+#include <cstdio>
+#include <dirent.h>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 namespace chimera
@@ -56,6 +60,7 @@ std::vector<const char *> convertArgs(const std::vector<std::string> &args)
 
 //==============================================================================
 Emulator::Emulator()
+  : shards_(0), minimal_includes_(false), incremental_(false), stats_(false)
 {
     // Do nothing
 }
@@ -77,6 +82,24 @@ void Emulator::Run()
     if (!modulename_.empty())
         args.push_back("-m=" + modulename_);
 
+    if (!output_path_.empty())
+        args.push_back("-o=" + output_path_);
+
+    if (shards_ != 0)
+        args.push_back("-shards=" + std::to_string(shards_));
+
+    if (minimal_includes_)
+        args.push_back("-minimal-includes");
+
+    if (incremental_)
+        args.push_back("-incremental");
+
+    if (!preamble_cache_.empty())
+        args.push_back("-preamble-cache=" + preamble_cache_);
+
+    if (stats_)
+        args.push_back("-stats");
+
     for (const auto &path : sources_)
     {
         const auto abs_path = GetExamplesDirPath() + path;
@@ -97,6 +120,79 @@ void Emulator::Run()
     exit(0);
 }
 
+//==============================================================================
+Emulator::Output Emulator::RunInDirectory(const std::string &directory)
+{
+    const std::string path = GetBuildPath() + "/" + directory;
+    mkdir(path.c_str(), 0755);
+    SetOutputPath(path);
+
+    Output output;
+    output.exit_code = -1;
+
+    // The emulator exits once it is done, so it runs in a child process whose
+    // stderr is read through a pipe.
+    int fds[2];
+    if (pipe(fds) != 0)
+        return output;
+
+    fflush(nullptr);
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[1]);
+        Run();
+    }
+    close(fds[1]);
+
+    char buffer[4096];
+    ssize_t size;
+    while ((size = read(fds[0], buffer, sizeof(buffer))) > 0)
+        output.errors.append(buffer, static_cast<std::size_t>(size));
+    close(fds[0]);
+
+    int status = 0;
+    if (pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status))
+        output.exit_code = WEXITSTATUS(status);
+
+    output.files = ReadFiles(path);
+    return output;
+}
+
+//==============================================================================
+void Emulator::RemoveDirectory(const std::string &directory)
+{
+    const std::string path = GetBuildPath() + "/" + directory;
+    for (const auto &it : ReadFiles(path))
+        unlink((path + "/" + it.first).c_str());
+    rmdir(path.c_str());
+}
+
+//==============================================================================
+std::map<std::string, std::string> Emulator::ReadFiles(const std::string &path)
+{
+    std::map<std::string, std::string> files;
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+        return files;
+
+    while (const dirent *entry = readdir(dir))
+    {
+        const std::string filename = entry->d_name;
+        if (filename == "." || filename == "..")
+            continue;
+
+        std::ifstream file(path + "/" + filename, std::ios::binary);
+        std::stringstream content;
+        content << file.rdbuf();
+        files[filename] = content.str();
+    }
+    closedir(dir);
+    return files;
+}
+
 //==============================================================================
 void Emulator::Run(const std::string &args)
 {
@@ -169,6 +265,12 @@ void Emulator::SetModuleName(const std::string &name)
     modulename_ = name;
 }
 
+//==============================================================================
+void Emulator::SetOutputPath(const std::string &path)
+{
+    output_path_ = path;
+}
+
 //==============================================================================
 void Emulator::SetBinding(const std::string &name)
 {
@@ -181,6 +283,36 @@ void Emulator::SetConfigurationFile(const std::string &path)
     config_filepath_ = GetExamplesDirPath() + path;
 }
 
+//==============================================================================
+void Emulator::SetShards(unsigned shards)
+{
+    shards_ = shards;
+}
+
+//==============================================================================
+void Emulator::SetMinimalIncludes(bool minimal)
+{
+    minimal_includes_ = minimal;
+}
+
+//==============================================================================
+void Emulator::SetIncremental(bool incremental)
+{
+    incremental_ = incremental;
+}
+
+//==============================================================================
+void Emulator::SetPreambleCache(const std::string &path)
+{
+    preamble_cache_ = path;
+}
+
+//==============================================================================
+void Emulator::SetStats(bool stats)
+{
+    stats_ = stats;
+}
+
 //==============================================================================
 const std::string &Emulator::GetExamplesDirPath()
 {
@@ -1,3 +1,4 @@
+#include <map>
 #include <string>
 #include <vector>
 #include "chimera/chimera.h"
@@ -10,10 +11,34 @@ namespace test
 class Emulator
 {
 public:
+    /// Result of a run in a child process (see RunInDirectory())
+    struct Output
+    {
+        /// Exit code of the child process, or -1 if it did not exit
+        int exit_code;
+
+        /// Everything that the run printed to stderr
+        std::string errors;
+
+        /// Contents of the files in the output directory, keyed by filename
+        std::map<std::string, std::string> files;
+    };
+
     Emulator();
 
     void Run();
 
+    /// Runs the emulator in a child process with its output written to the
+    /// given directory under the build path, which is created if needed.
+    Output RunInDirectory(const std::string &directory);
+
+    /// Removes a directory under the build path and the files in it.
+    static void RemoveDirectory(const std::string &directory);
+
+    /// Reads the contents of every file in a directory, keyed by filename.
+    static std::map<std::string, std::string> ReadFiles(
+        const std::string &path);
+
     static void Run(const std::string &args);
 
     static void RunHelp();
@@ -25,10 +50,22 @@ public:
 
     void SetModuleName(const std::string &name);
 
+    void SetOutputPath(const std::string &path);
+
     void SetBinding(const std::string &name);
 
     void SetConfigurationFile(const std::string &path);
 
+    void SetShards(unsigned shards);
+
+    void SetMinimalIncludes(bool minimal);
+
+    void SetIncremental(bool incremental);
+
+    void SetPreambleCache(const std::string &path);
+
+    void SetStats(bool stats);
+
     static const std::string &GetExamplesDirPath();
     static const std::string &GetBuildPath();
 
@@ -42,8 +79,26 @@ private:
     /// Output top-level module name for option '-m'
     std::string modulename_;
 
+    /// Output bindings directory for option '-o'
+    std::string output_path_;
+
     /// Sources paths
     std::vector<std::string> sources_;
+
+    /// Number of shard files for option '-shards'
+    unsigned shards_;
+
+    /// Whether to pass option '-minimal-includes'
+    bool minimal_includes_;
+
+    /// Whether to pass option '-incremental'
+    bool incremental_;
+
+    /// Preamble cache directory for option '-preamble-cache'
+    std::string preamble_cache_;
+
+    /// Whether to pass option '-stats'
+    bool stats_;
 };
 
 } // namespace test
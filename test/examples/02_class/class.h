@@ -43,6 +43,17 @@ public:
   std::string pure_virtual_type() const override;
 };
 
+class Swimmer {};
+
+class Runner {};
+
+// The bases are listed in a different order than they are declared in.
+class Triathlete : public Runner, public Swimmer, public Strong
+{
+public:
+  Triathlete() = default;
+};
+
 class DefaultArguments
 {
 public:
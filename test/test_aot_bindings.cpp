@@ -0,0 +1,122 @@
+#include <regex>
+#include <set>
+#include <gtest/gtest.h>
+#include <mstch/mstch.hpp>
+#include "chimera/binding.h"
+
+using namespace chimera;
+
+namespace
+{
+
+/**
+ * Collects the key segments referenced by the tags of a template.
+ */
+std::set<std::string> templateKeys(const std::string &source)
+{
+    std::set<std::string> keys;
+    const std::regex tag("\\{\\{[#^/&{]?\\s*([A-Za-z0-9_.?]+)");
+    for (std::sregex_iterator it(source.begin(), source.end(), tag), end;
+         it != end; ++it)
+    {
+        const std::string name = (*it)[1];
+        std::size_t begin = 0;
+        for (;;)
+        {
+            const auto dot = name.find('.', begin);
+            keys.insert(name.substr(begin, dot - begin));
+            if (dot == std::string::npos)
+                break;
+            begin = dot + 1;
+        }
+    }
+    return keys;
+}
+
+/**
+ * Builds a context that assigns every key a value that depends on the key,
+ * the depth and the seed, so that each seed exercises different branches of
+ * the template.
+ */
+::mstch::node makeContext(const std::set<std::string> &keys, unsigned seed,
+                          int depth = 0)
+{
+    ::mstch::map context;
+    for (const auto &key : keys)
+    {
+        unsigned hash = seed * 2654435761u + depth * 40503u;
+        for (const char c : key)
+            hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+
+        // Limit the nesting depth of the generated contexts.
+        const unsigned choice = (depth < 2) ? (hash >> 8) % 7 : (hash >> 8) % 4;
+        switch (choice)
+        {
+            case 0:
+                break;
+            case 1:
+                context[key] = false;
+                break;
+            case 2:
+                context[key] = true;
+                break;
+            case 3:
+                context[key] = "<" + key + " & " + std::to_string(depth) + ">";
+                break;
+            case 4:
+                context[key] = ::mstch::array{
+                    makeContext(keys, seed + 1, depth + 1),
+                    makeContext(keys, seed + 2, depth + 1),
+                };
+                break;
+            case 5:
+                context[key] = makeContext(keys, seed + 3, depth + 1);
+                break;
+            case 6:
+                context[key] = ::mstch::array{};
+                break;
+        }
+    }
+    return context;
+}
+
+void expectIdenticalOutput(const std::string &source,
+                           ::mstch::aot::render_function function)
+{
+    ASSERT_NE(function, nullptr);
+
+    const ::mstch::compiled_template interpreted(source);
+    const ::mstch::compiled_template compiled(function);
+    const auto keys = templateKeys(source);
+
+    for (unsigned seed = 0; seed < 50; ++seed)
+    {
+        const ::mstch::node context = makeContext(keys, seed);
+        EXPECT_EQ(::mstch::render(interpreted, context),
+                  ::mstch::render(compiled, context))
+            << "seed: " << seed;
+    }
+}
+
+} // namespace
+
+//==============================================================================
+TEST(AotBindings, IdenticalOutput)
+{
+    ASSERT_FALSE(binding::DEFINITIONS.empty());
+
+    for (const auto &entry : binding::DEFINITIONS)
+    {
+        SCOPED_TRACE(entry.first);
+        const binding::Definition &definition = entry.second;
+
+        expectIdenticalOutput(definition.class_cpp, definition.class_render);
+        expectIdenticalOutput(definition.enum_cpp, definition.enum_render);
+        expectIdenticalOutput(definition.function_cpp,
+                              definition.function_render);
+        expectIdenticalOutput(definition.module_cpp, definition.module_render);
+        expectIdenticalOutput(definition.prelude_h, definition.prelude_render);
+        expectIdenticalOutput(definition.variable_cpp,
+                              definition.variable_render);
+    }
+}
@@ -1,3 +1,8 @@
+#include <cstdio>
+#include <map>
+#include <set>
+#include <sstream>
+#include <utility>
 #include <clang/Frontend/FrontendActions.h>
 #include <clang/Tooling/Tooling.h>
 #include <gtest/gtest.h>
@@ -7,6 +12,66 @@
 using namespace chimera;
 using namespace chimera::test;
 
+namespace
+{
+
+/**
+ * Parses the numbers of files that a run wrote and left unchanged from the
+ * statistics that it printed to stderr.
+ */
+std::pair<unsigned, unsigned> getGeneratedFiles(const std::string &errors)
+{
+    unsigned written = 0;
+    unsigned unchanged = 0;
+    const std::size_t found = errors.find("Generated files: ");
+    if (found != std::string::npos)
+        std::sscanf(errors.c_str() + found,
+                    "Generated files: %u written, %u unchanged.", &written,
+                    &unchanged);
+    return std::make_pair(written, unchanged);
+}
+
+/**
+ * Parses the numbers of preambles that a run reused from the preamble cache
+ * and generated from the statistics that it printed to stderr.
+ */
+std::pair<unsigned, unsigned> getCachedPreambles(const std::string &errors)
+{
+    unsigned reused = 0;
+    unsigned generated = 0;
+    const std::size_t found = errors.find("Cached preambles: ");
+    if (found != std::string::npos)
+        std::sscanf(errors.c_str() + found,
+                    "Cached preambles: %u reused, %u generated.", &reused,
+                    &generated);
+    return std::make_pair(reused, generated);
+}
+
+/**
+ * Finds the shard of each binding in the files of a sharded run, keyed by
+ * the name of the function that the binding defines.
+ */
+std::map<std::string, std::string> getShardsOfBindings(
+    const std::map<std::string, std::string> &files)
+{
+    std::map<std::string, std::string> shards;
+    for (const auto &it : files)
+    {
+        if (it.first.find("_shard_") == std::string::npos)
+            continue;
+
+        std::istringstream content(it.second);
+        std::string line;
+        while (std::getline(content, line))
+            if (line.compare(0, 5, "void ") == 0
+                && line.find("module& m)") != std::string::npos)
+                shards[line.substr(5, line.find('(') - 5)] = it.first;
+    }
+    return shards;
+}
+
+} // namespace
+
 //==============================================================================
 TEST(Emulator, GeneralOptions)
 {
@@ -51,6 +116,192 @@ TEST(Emulator, 02_Class)
     EXPECT_EXIT(e.Run(), ::testing::ExitedWithCode(0), ".*");
 }
 
+//==============================================================================
+TEST(Emulator, 02_ClassSharded)
+{
+    // The bindings are packed into exactly the given number of shards, next
+    // to the top-level module and the prelude header.
+    Emulator::RemoveDirectory("02_class_sharded");
+
+    Emulator e;
+    e.SetSource("02_class/class.h");
+    e.SetConfigurationFile("02_class/class.yaml");
+    e.SetBinding("pybind11");
+    e.SetShards(2);
+
+    const Emulator::Output first = e.RunInDirectory("02_class_sharded");
+    EXPECT_EQ(first.exit_code, 0);
+
+    std::set<std::string> filenames;
+    for (const auto &it : first.files)
+        filenames.insert(it.first);
+    const std::set<std::string> expected{
+        "chimera_binding.cpp", "chimera_binding_prelude.h",
+        "chimera_binding_shard_0.cpp", "chimera_binding_shard_1.cpp"};
+    EXPECT_EQ(filenames, expected);
+
+    // A binding that is added by another source must not move the existing
+    // bindings to other shards.
+    e.SetSources({"02_class/class.h", "05_variable/variable.h"});
+    const Emulator::Output second = e.RunInDirectory("02_class_sharded");
+    EXPECT_EQ(second.exit_code, 0);
+
+    const auto first_shards = getShardsOfBindings(first.files);
+    const auto second_shards = getShardsOfBindings(second.files);
+    EXPECT_FALSE(first_shards.empty());
+    EXPECT_GT(second_shards.size(), first_shards.size());
+    for (const auto &it : first_shards)
+    {
+        const auto found = second_shards.find(it.first);
+        ASSERT_NE(found, second_shards.end()) << it.first;
+        EXPECT_EQ(found->second, it.second) << it.first;
+    }
+}
+
+//==============================================================================
+TEST(Emulator, 02_ClassMinimalIncludes)
+{
+    // Each binding includes the header that declares its class, and the
+    // prelude no longer includes the sources.
+    Emulator::RemoveDirectory("02_class_minimal_includes");
+
+    Emulator e;
+    e.SetSource("02_class/class.h");
+    e.SetConfigurationFile("02_class/class.yaml");
+    e.SetBinding("pybind11");
+    e.SetMinimalIncludes(true);
+
+    const Emulator::Output output
+        = e.RunInDirectory("02_class_minimal_includes");
+    EXPECT_EQ(output.exit_code, 0);
+
+    const auto prelude = output.files.find("chimera_binding_prelude.h");
+    ASSERT_NE(prelude, output.files.end());
+    EXPECT_EQ(prelude->second.find("class.h"), std::string::npos);
+
+    unsigned num_bindings = 0;
+    for (const auto &it : output.files)
+    {
+        if (it.first == "chimera_binding.cpp"
+            || it.first == "chimera_binding_prelude.h")
+            continue;
+
+        ++num_bindings;
+        EXPECT_NE(it.second.find("/02_class/class.h>"), std::string::npos)
+            << it.first;
+    }
+    EXPECT_GT(num_bindings, 0u);
+}
+
+//==============================================================================
+TEST(Emulator, 02_ClassDeterministic)
+{
+    // Generate the bindings twice and compare the outputs byte-for-byte.
+    Emulator e;
+    e.SetSource("02_class/class.h");
+    e.SetConfigurationFile("02_class/class.yaml");
+    e.SetBinding("pybind11");
+
+    std::vector<Emulator::Output> outputs;
+    for (const std::string run : {"0", "1"})
+    {
+        Emulator::RemoveDirectory("02_class_deterministic_" + run);
+        outputs.push_back(e.RunInDirectory("02_class_deterministic_" + run));
+        EXPECT_EQ(outputs.back().exit_code, 0);
+    }
+
+    EXPECT_FALSE(outputs[0].files.empty());
+    EXPECT_EQ(outputs[0].files, outputs[1].files);
+
+    // Both runs share the same heap layout, so also check that the bases of
+    // a class are listed in the order in which they are declared, rather
+    // than in the order of their declarations in memory.
+    const std::vector<std::string> expected_bases{
+        "::Runner, ", "::Swimmer, ", "::Strong >"};
+    std::string triathlete;
+    for (const auto &it : outputs[0].files)
+    {
+        std::istringstream content(it.second);
+        std::string line;
+        while (std::getline(content, line))
+            if (line.find("class_<") != std::string::npos
+                && line.find("::Triathlete,") != std::string::npos)
+                triathlete = line;
+    }
+    ASSERT_FALSE(triathlete.empty());
+    std::size_t position = 0;
+    for (const std::string &base : expected_bases)
+    {
+        const std::size_t found = triathlete.find(base, position);
+        ASSERT_NE(found, std::string::npos) << base << " in " << triathlete;
+        position = found + base.size();
+    }
+}
+
+//==============================================================================
+TEST(Emulator, 02_ClassIncremental)
+{
+    // The first run writes every file, and the second run skips every
+    // binding, and must list and leave the same files as the first run.
+    Emulator::RemoveDirectory("02_class_incremental");
+
+    Emulator e;
+    e.SetSource("02_class/class.h");
+    e.SetConfigurationFile("02_class/class.yaml");
+    e.SetBinding("pybind11");
+    e.SetIncremental(true);
+
+    std::vector<Emulator::Output> outputs;
+    for (int run = 0; run < 2; ++run)
+    {
+        outputs.push_back(e.RunInDirectory("02_class_incremental"));
+        EXPECT_EQ(outputs.back().exit_code, 0);
+    }
+
+    EXPECT_EQ(outputs[0].files, outputs[1].files);
+    EXPECT_EQ(outputs[1].files.count("chimera_binding.fingerprints"), 1u);
+
+    const auto first = getGeneratedFiles(outputs[0].errors);
+    const auto second = getGeneratedFiles(outputs[1].errors);
+    EXPECT_GT(first.first, 0u);
+    EXPECT_EQ(first.second, 0u);
+    EXPECT_EQ(second.first, 0u);
+    EXPECT_EQ(second.second, first.first);
+}
+
+//==============================================================================
+TEST(Emulator, 02_ClassPreambleCache)
+{
+    // The first run parses from scratch, the second run generates the cached
+    // preamble and the third run reuses it, which must not change the output.
+    Emulator::RemoveDirectory("02_class_preamble");
+    Emulator::RemoveDirectory("02_class_preamble_cache");
+    const std::string cache_path
+        = Emulator::GetBuildPath() + "/02_class_preamble_cache";
+
+    Emulator e;
+    e.SetSource("02_class/class.h");
+    e.SetConfigurationFile("02_class/class.yaml");
+    e.SetBinding("pybind11");
+    e.SetStats(true);
+
+    std::vector<Emulator::Output> outputs;
+    for (int run = 0; run < 3; ++run)
+    {
+        if (run > 0)
+            e.SetPreambleCache(cache_path);
+
+        outputs.push_back(e.RunInDirectory("02_class_preamble"));
+        EXPECT_EQ(outputs.back().exit_code, 0);
+    }
+
+    EXPECT_EQ(outputs[0].files, outputs[1].files);
+    EXPECT_EQ(outputs[0].files, outputs[2].files);
+    EXPECT_EQ(Emulator::ReadFiles(cache_path).size(), 2u);
+    EXPECT_EQ(getCachedPreambles(outputs[1].errors), std::make_pair(0u, 1u));
+    EXPECT_EQ(getCachedPreambles(outputs[2].errors), std::make_pair(1u, 0u));
+}
+
 //==============================================================================
 TEST(Emulator, 04_Enumeration)
 {
@@ -64,6 +315,68 @@ TEST(Emulator, 04_Enumeration)
     EXPECT_EXIT(e.Run(), ::testing::ExitedWithCode(0), ".*");
 }
 
+//==============================================================================
+TEST(Emulator, MultipleSources)
+{
+    // Generate the bindings of each source on its own, and of both sources in
+    // a single run in which the first source is passed twice.  The single run
+    // must generate the bindings of both sources, each of them only once.
+    const std::vector<std::vector<std::string>> runs{
+        {"02_class/class.h"},
+        {"05_variable/variable.h"},
+        {"02_class/class.h", "05_variable/variable.h", "02_class/class.h"}};
+    std::vector<std::set<std::string>> filenames;
+    for (std::size_t run = 0; run < runs.size(); ++run)
+    {
+        const std::string directory = "multiple_sources_" + std::to_string(run);
+        Emulator::RemoveDirectory(directory);
+
+        Emulator e;
+        e.SetSources(runs[run]);
+        e.SetConfigurationFile("05_variable/variable.yaml");
+        e.SetBinding("pybind11");
+
+        const Emulator::Output output = e.RunInDirectory(directory);
+        EXPECT_EQ(output.exit_code, 0);
+        std::set<std::string> run_filenames;
+        for (const auto &it : output.files)
+            run_filenames.insert(it.first);
+        filenames.push_back(run_filenames);
+    }
+
+    std::set<std::string> expected = filenames[0];
+    expected.insert(filenames[1].begin(), filenames[1].end());
+    EXPECT_GT(expected.size(), filenames[0].size());
+    EXPECT_EQ(filenames[2], expected);
+}
+
+//==============================================================================
+TEST(Emulator, MultipleSourcesPartialConfiguration)
+{
+    // The configuration names a class that is only declared by one of the
+    // sources, which is an error unless at least one source declares it.
+    Emulator e;
+    e.SetConfigurationFile("05_variable/variable_with_class.yaml");
+    e.SetBinding("pybind11");
+
+    Emulator::RemoveDirectory("multiple_sources_partial");
+    e.SetSources({"05_variable/variable.h", "02_class/class.h"});
+    const Emulator::Output resolved
+        = e.RunInDirectory("multiple_sources_partial");
+    EXPECT_EQ(resolved.exit_code, 0);
+    EXPECT_EQ(resolved.errors.find("Unable to resolve"), std::string::npos);
+    EXPECT_EQ(resolved.files.count("chimera_binding.cpp"), 1u);
+
+    Emulator::RemoveDirectory("multiple_sources_unresolved");
+    e.SetSources({"05_variable/variable.h", "05_variable/variable.h"});
+    const Emulator::Output unresolved
+        = e.RunInDirectory("multiple_sources_unresolved");
+    EXPECT_NE(unresolved.exit_code, 0);
+    EXPECT_NE(unresolved.errors.find(
+                  "Unable to resolve class declaration: 'chimera_test::Dog'"),
+              std::string::npos);
+}
+
 //==============================================================================
 TEST(Emulator, 20_Eigen)
 {